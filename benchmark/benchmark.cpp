@@ -0,0 +1,389 @@
+/**
+ * Headless benchmark of the engine plugin. Compiles a GIF corpus with the
+ * plugin resource compiler, then replays a spawn, update and unspawn
+ * workload against the stand-in engine APIs, and reports the spawn latency,
+ * update_plugin time, render thread upload time and bytes uploaded.
+ */
+
+#include "fake_engine.h"
+#include "synthetic_gif.h"
+
+#include <engine_plugin_api/plugin_api.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <dirent.h>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" void* get_plugin_api(unsigned api);
+
+using namespace giphy_benchmark;
+
+namespace {
+
+struct Options
+{
+	unsigned unit_count = 256;
+	unsigned frame_count = 600;
+	unsigned spawn_per_frame = 0;
+	double dt = 1.0 / 60.0;
+	std::vector<std::string> gif_paths;
+	unsigned synthetic_width = 256;
+	unsigned synthetic_height = 256;
+	unsigned synthetic_frames = 24;
+	bool synthetic_transparent = false;
+	bool palette_slot = false;
+	bool texture_array = false;
+	bool shared_clock = false;
+	const char* platform = "win64";
+	bool verbose = false;
+};
+
+void print_usage()
+{
+	printf(
+		"usage: giphy_benchmark [options] [file.gif | directory]...\n"
+		"Replays spawn/update/unspawn workloads against the giphy engine plugin.\n"
+		"\n"
+		"  --units N              units spawned (256)\n"
+		"  --frames N             game frames updated after spawning (600)\n"
+		"  --spawn-per-frame N    units spawned per frame, 0 to spawn all before the first frame (0)\n"
+		"  --dt SECONDS           game frame time (0.016667)\n"
+		"  --synthetic WxHxF      synthetic GIF played without a corpus (256x256x24)\n"
+		"  --transparent          make the synthetic GIF transparent\n"
+		"  --palette              give units a palette slot, sampling indexed frames\n"
+		"  --texture-array        give units a frame index variable, playing from texture arrays\n"
+		"  --shared-clock         make units of the same GIF share their playback\n"
+		"  --platform NAME        destination platform of the compiled resources (win64)\n"
+		"  --verbose              print the plugin info logs\n");
+}
+
+bool parse_options(int argc, char** argv, Options& options)
+{
+	for (int i = 1; i < argc; ++i) {
+		const char* arg = argv[i];
+		const bool has_value = i + 1 < argc;
+		if (strcmp(arg, "--units") == 0 && has_value)
+			options.unit_count = (unsigned)atoi(argv[++i]);
+		else if (strcmp(arg, "--frames") == 0 && has_value)
+			options.frame_count = (unsigned)atoi(argv[++i]);
+		else if (strcmp(arg, "--spawn-per-frame") == 0 && has_value)
+			options.spawn_per_frame = (unsigned)atoi(argv[++i]);
+		else if (strcmp(arg, "--dt") == 0 && has_value)
+			options.dt = atof(argv[++i]);
+		else if (strcmp(arg, "--synthetic") == 0 && has_value) {
+			if (sscanf(argv[++i], "%ux%ux%u", &options.synthetic_width, &options.synthetic_height, &options.synthetic_frames) != 3)
+				return false;
+		} else if (strcmp(arg, "--transparent") == 0)
+			options.synthetic_transparent = true;
+		else if (strcmp(arg, "--palette") == 0)
+			options.palette_slot = true;
+		else if (strcmp(arg, "--texture-array") == 0)
+			options.texture_array = true;
+		else if (strcmp(arg, "--shared-clock") == 0)
+			options.shared_clock = true;
+		else if (strcmp(arg, "--platform") == 0 && has_value)
+			options.platform = argv[++i];
+		else if (strcmp(arg, "--verbose") == 0)
+			options.verbose = true;
+		else if (arg[0] != '-')
+			options.gif_paths.push_back(arg);
+		else
+			return false;
+	}
+	return options.unit_count > 0 && options.synthetic_width > 0 && options.synthetic_height > 0 && options.synthetic_frames > 0;
+}
+
+bool has_gif_extension(const std::string& path)
+{
+	return path.size() > 4 && strcasecmp(path.c_str() + path.size() - 4, ".gif") == 0;
+}
+
+/**
+ * Returns the GIF files of the corpus, listing directories.
+ */
+std::vector<std::string> corpus_files(const std::vector<std::string>& paths)
+{
+	std::vector<std::string> files;
+	for (const auto& path : paths) {
+		auto dir = opendir(path.c_str());
+		if (dir == nullptr) {
+			files.push_back(path);
+			continue;
+		}
+		std::vector<std::string> dir_files;
+		while (auto entry = readdir(dir)) {
+			if (has_gif_extension(entry->d_name))
+				dir_files.push_back(path + "/" + entry->d_name);
+		}
+		closedir(dir);
+		std::sort(dir_files.begin(), dir_files.end());
+		files.insert(files.end(), dir_files.begin(), dir_files.end());
+	}
+	return files;
+}
+
+bool read_file(const std::string& path, std::vector<char>& data)
+{
+	auto file = fopen(path.c_str(), "rb");
+	if (file == nullptr)
+		return false;
+	fseek(file, 0, SEEK_END);
+	data.resize((size_t)ftell(file));
+	fseek(file, 0, SEEK_SET);
+	const bool read = fread(data.data(), 1, data.size(), file) == data.size();
+	fclose(file);
+	return read;
+}
+
+/**
+ * Compiles the corpus, or a synthetic GIF, and returns the names of the
+ * resources compiled.
+ */
+std::vector<std::string> compile_corpus(const Options& options)
+{
+	std::vector<std::string> names;
+	if (options.gif_paths.empty()) {
+		auto source = make_synthetic_gif(options.synthetic_width, options.synthetic_height, options.synthetic_frames, options.synthetic_transparent);
+		auto error = compile_gif_resource("synthetic", "synthetic.gif", source, options.platform);
+		if (error)
+			fprintf(stderr, "synthetic.gif: %s\n", error);
+		else
+			names.push_back("synthetic");
+		return names;
+	}
+
+	for (const auto& path : corpus_files(options.gif_paths)) {
+		std::vector<char> source;
+		if (!read_file(path, source)) {
+			fprintf(stderr, "%s: cannot read file\n", path.c_str());
+			continue;
+		}
+		auto name = path.substr(0, path.size() - (has_gif_extension(path) ? 4 : 0));
+		auto error = compile_gif_resource(name.c_str(), path.c_str(), source, options.platform);
+		if (error) {
+			fprintf(stderr, "%s: %s\n", path.c_str(), error);
+			continue;
+		}
+		names.push_back(name);
+	}
+	return names;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Render thread beginning its frames one frame behind the game thread, as the
+ * engine does, so the texture updates get executed while the game thread
+ * updates the next frame.
+ */
+class RenderThread
+{
+public:
+	explicit RenderThread(RenderCallbacksPluginApi* render_callbacks)
+		: _render_callbacks(render_callbacks), _thread(&RenderThread::run, this) {}
+
+	~RenderThread()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_quit = true;
+		}
+		_condition.notify_all();
+		_thread.join();
+	}
+
+	/**
+	 * Waits for the render thread to finish its frame, and begins the next one.
+	 */
+	void begin_frame()
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_condition.wait(lock, [this] { return _rendered == _begun; });
+		++_begun;
+		_condition.notify_all();
+	}
+
+	/**
+	 * Waits for the render thread to finish its frame.
+	 */
+	void finish()
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_condition.wait(lock, [this] { return _rendered == _begun; });
+	}
+
+	/**
+	 * Time spent in the plugin begin_frame callback and bytes uploaded each
+	 * render frame.
+	 */
+	const std::vector<double>& frame_times() const { return _frame_times; }
+	const std::vector<double>& frame_uploads() const { return _frame_uploads; }
+
+private:
+	void run()
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		for (;;) {
+			_condition.wait(lock, [this] { return _quit || _rendered < _begun; });
+			if (_rendered == _begun)
+				return;
+			lock.unlock();
+			const auto uploaded_bytes = engine_counters.uploaded_bytes.load();
+			const auto start = std::chrono::steady_clock::now();
+			_render_callbacks->begin_frame();
+			const auto time = seconds_since(start);
+			lock.lock();
+			_frame_times.push_back(time);
+			_frame_uploads.push_back((double)(engine_counters.uploaded_bytes.load() - uploaded_bytes));
+			++_rendered;
+			_condition.notify_all();
+		}
+	}
+
+	RenderCallbacksPluginApi* _render_callbacks;
+	std::mutex _mutex;
+	std::condition_variable _condition;
+	uint64_t _begun = 0;
+	uint64_t _rendered = 0;
+	bool _quit = false;
+	std::vector<double> _frame_times;
+	std::vector<double> _frame_uploads;
+	std::thread _thread;
+};
+
+double percentile(std::vector<double> values, double p)
+{
+	if (values.empty())
+		return 0.0;
+	std::sort(values.begin(), values.end());
+	size_t rank = (size_t)(p * values.size() + 0.999999);
+	rank = rank > 0 ? rank - 1 : 0;
+	return values[std::min(rank, values.size() - 1)];
+}
+
+void print_times(const char* name, const std::vector<double>& seconds)
+{
+	double total = 0.0;
+	for (auto s : seconds)
+		total += s;
+	printf("%-24s p50 %9.3f ms  p99 %9.3f ms  max %9.3f ms  total %10.3f ms  (%zu samples)\n", name,
+		percentile(seconds, 0.5) * 1000.0, percentile(seconds, 0.99) * 1000.0, percentile(seconds, 1.0) * 1000.0,
+		total * 1000.0, seconds.size());
+}
+
+void print_bytes(const char* name, const std::vector<double>& bytes)
+{
+	double total = 0.0;
+	for (auto b : bytes)
+		total += b;
+	printf("%-24s p50 %12.0f B  p99 %12.0f B  max %12.0f B  total %14.0f B\n", name,
+		percentile(bytes, 0.5), percentile(bytes, 0.99), percentile(bytes, 1.0), total);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!parse_options(argc, argv, options)) {
+		print_usage();
+		return 1;
+	}
+	set_verbose(options.verbose);
+
+	auto plugin = (PluginApi*)get_plugin_api(PLUGIN_API_ID);
+	auto render_callbacks = (RenderCallbacksPluginApi*)get_plugin_api(RENDER_CALLBACKS_PLUGIN_API_ID);
+
+	// Compile the corpus the way the data compiler would, in its own session.
+	const auto compile_start = std::chrono::steady_clock::now();
+	plugin->setup_data_compiler(get_engine_api);
+	auto resource_names = compile_corpus(options);
+	plugin->shutdown_data_compiler();
+	const auto compile_time = seconds_since(compile_start);
+	if (resource_names.empty()) {
+		fprintf(stderr, "No GIF compiled.\n");
+		return 1;
+	}
+
+	plugin->setup_resources(get_engine_api);
+	plugin->setup_game(get_engine_api);
+	const auto load_start = std::chrono::steady_clock::now();
+	load_resources();
+	const auto load_time = seconds_since(load_start);
+	reset_profile_scope_times();
+
+	std::vector<CApiUnit*> units;
+	for (unsigned i = 0; i < options.unit_count; ++i) {
+		UnitDescription description = {};
+		description.giphy_resource = resource_names[i % resource_names.size()].c_str();
+		description.material_slot_name = "albedo_map";
+		description.palette_slot_name = options.palette_slot ? "palette_map" : nullptr;
+		description.frame_index_variable = options.texture_array ? "frame_index" : nullptr;
+		description.shared_clock = options.shared_clock;
+		description.mesh_count = 1;
+		description.unit_resource_name = 0x9f1b2c3d4e5f6071ull + (i % 4);
+		units.push_back(make_unit(description));
+	}
+
+	// Spawn units over the first frames if asked, then keep updating. The
+	// render thread executes the updates of a frame while the next one
+	// updates, and already began a frame when the game starts.
+	std::vector<double> spawn_times, update_times;
+	RenderThread render_thread(render_callbacks);
+	render_thread.begin_frame();
+	unsigned spawned = 0;
+	const unsigned spawn_per_frame = options.spawn_per_frame > 0 ? options.spawn_per_frame : options.unit_count;
+	const auto run_start = std::chrono::steady_clock::now();
+	for (unsigned frame = 0; frame < options.frame_count || spawned < units.size(); ++frame) {
+		for (unsigned s = 0; s < spawn_per_frame && spawned < units.size(); ++s) {
+			const auto spawn_start = std::chrono::steady_clock::now();
+			plugin->units_spawned(&units[spawned++], 1);
+			spawn_times.push_back(seconds_since(spawn_start));
+		}
+
+		const auto update_start = std::chrono::steady_clock::now();
+		plugin->update_game((float)options.dt);
+		update_times.push_back(seconds_since(update_start));
+
+		render_thread.begin_frame();
+	}
+	render_thread.finish();
+	const auto run_time = seconds_since(run_start);
+
+	const auto unspawn_start = std::chrono::steady_clock::now();
+	plugin->units_unspawned(units.data(), (unsigned)units.size());
+	const auto unspawn_time = seconds_since(unspawn_start);
+	for (auto unit : units)
+		destroy_unit(unit);
+
+	unload_resources();
+	plugin->shutdown_game();
+
+	printf("corpus: %zu GIF, %u units, %zu frames of %.2f ms, platform %s\n", resource_names.size(), options.unit_count,
+		update_times.size(), options.dt * 1000.0, options.platform);
+	printf("compile %.3f ms, load %.3f ms, run %.3f ms, unspawn %.3f ms\n\n",
+		compile_time * 1000.0, load_time * 1000.0, run_time * 1000.0, unspawn_time * 1000.0);
+	print_times("spawn latency", spawn_times);
+	print_times("update_plugin", update_times);
+	print_times("render begin_frame", render_thread.frame_times());
+	print_bytes("uploaded per frame", render_thread.frame_uploads());
+	printf("\nuploads %llu, texture memory created %llu B, material updates %llu, peak plugin memory %llu B\n",
+		(unsigned long long)engine_counters.uploads.load(), (unsigned long long)engine_counters.created_buffer_bytes.load(),
+		(unsigned long long)engine_counters.material_updates.load(), (unsigned long long)engine_counters.peak_plugin_memory.load());
+
+	printf("\nprofiler scopes:\n");
+	for (const auto& scope : profile_scope_times())
+		printf("  %-28s %10.3f ms  %8llu calls\n", scope.name.c_str(), scope.seconds * 1000.0, (unsigned long long)scope.count);
+	return 0;
+}
@@ -0,0 +1,939 @@
+#include "fake_engine.h"
+
+#include <engine_plugin_api/c_api/c_api_dynamic_script_data.h>
+#include <engine_plugin_api/c_api/c_api_material.h>
+#include <engine_plugin_api/c_api/c_api_mesh.h>
+#include <engine_plugin_api/c_api/c_api_unit.h>
+#include <engine_plugin_api/plugin_c_api.h>
+#include <plugin_foundation/id_string.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+using namespace giphy_benchmark;
+using stingray_plugin_foundation::IdString64;
+
+/**
+ * Stand-in definitions of the engine objects the plugin only handles through
+ * opaque pointers.
+ */
+struct AllocatorObject
+{
+	std::string name;
+};
+
+struct ThreadEvent
+{
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool manual_reset;
+	bool set;
+};
+
+struct ThreadCriticalSection
+{
+	std::recursive_mutex mutex;
+};
+
+struct CApiMaterial
+{
+	std::map<unsigned, ConstRenderResourcePtr> resources;
+	std::map<unsigned, float> scalars;
+};
+
+struct CApiMesh
+{
+	CApiMaterial material;
+	CApiMatrix4x4 pose;
+};
+
+struct ScriptDataValue
+{
+	std::string string;
+	float number;
+	char boolean;
+	DynamicScriptDataType type;
+};
+
+struct CApiUnit
+{
+	CApiUnitRef ref;
+	uint64_t resource_name;
+	std::deque<CApiMesh> meshes;
+	std::map<std::string, ScriptDataValue> script_data;
+};
+
+// A memory backed stream serves as future archive, archive and input buffer
+// at once, its data being always available.
+struct MemoryStream
+{
+	const char* data;
+	int64_t size;
+	int64_t position;
+};
+
+struct FutureInputArchive { MemoryStream stream; };
+struct InputArchive { MemoryStream stream; };
+struct InputBuffer { MemoryStream stream; };
+
+struct DataCompileParameters
+{
+	const char* source_path;
+	const std::vector<char>* source;
+	const char* platform;
+	AllocatorObject* allocator;
+
+	// Source data read by the compiler, freed once compiled.
+	char* read_data;
+};
+
+namespace giphy_benchmark {
+
+EngineCounters engine_counters;
+
+namespace {
+
+bool verbose = false;
+
+// Allocators
+
+// Header stored in front of each allocation, to free it and track its size.
+struct AllocationHeader
+{
+	void* block;
+	size_t size;
+};
+
+AllocatorObject* make_plugin_allocator(const char* plugin_name)
+{
+	auto allocator = new AllocatorObject;
+	allocator->name = plugin_name;
+	return allocator;
+}
+
+void destroy_plugin_allocator(AllocatorObject* allocator)
+{
+	delete allocator;
+}
+
+void* allocate(AllocatorObject*, size_t size, unsigned align)
+{
+	if (align < alignof(AllocationHeader))
+		align = alignof(AllocationHeader);
+	auto block = (char*)malloc(size + sizeof(AllocationHeader) + align);
+	if (block == nullptr)
+		return nullptr;
+	auto p = block + sizeof(AllocationHeader);
+	p += (align - (uintptr_t)p % align) % align;
+	auto header = (AllocationHeader*)p - 1;
+	header->block = block;
+	header->size = size;
+
+	const auto memory = engine_counters.plugin_memory.fetch_add(size) + size;
+	auto peak = engine_counters.peak_plugin_memory.load();
+	while (memory > peak && !engine_counters.peak_plugin_memory.compare_exchange_weak(peak, memory)) {}
+	return p;
+}
+
+size_t deallocate(AllocatorObject*, void* p)
+{
+	if (p == nullptr)
+		return 0;
+	auto header = (AllocationHeader*)p - 1;
+	const auto size = header->size;
+	engine_counters.plugin_memory.fetch_sub(size);
+	free(header->block);
+	return size;
+}
+
+// Logging and errors
+
+void log_info(const char* system, const char* info)
+{
+	if (verbose)
+		printf("[%s] %s\n", system, info);
+}
+
+void log_warning(const char* system, const char* warning)
+{
+	fprintf(stderr, "[%s] warning: %s\n", system, warning);
+}
+
+const char* eprintf(const char* msg, ...)
+{
+	thread_local char buffer[2048];
+	va_list args;
+	va_start(args, msg);
+	vsnprintf(buffer, sizeof(buffer), msg, args);
+	va_end(args);
+	return buffer;
+}
+
+// Profiler and timer
+
+struct OpenScope
+{
+	const char* name;
+	std::chrono::steady_clock::time_point start;
+};
+thread_local std::vector<OpenScope> open_scopes;
+
+std::mutex scope_times_mutex;
+std::map<std::string, ProfileScopeTime> scope_times;
+
+void profile_start(const char* name)
+{
+	open_scopes.push_back({ name, std::chrono::steady_clock::now() });
+}
+
+void profile_stop()
+{
+	const auto scope = open_scopes.back();
+	open_scopes.pop_back();
+	const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - scope.start;
+
+	std::lock_guard<std::mutex> lock(scope_times_mutex);
+	auto& time = scope_times[scope.name];
+	time.name = scope.name;
+	time.seconds += duration.count();
+	++time.count;
+}
+
+void make_thread_profiler(AllocatorObject*) {}
+void delete_thread_profiler(AllocatorObject*) {}
+
+uint64_t ticks()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double ticks_to_seconds(uint64_t ticks)
+{
+	return ticks / 1e9;
+}
+
+// Threads
+
+ThreadID create_thread(const char*, ThreadEntry entry, void* user_data, int)
+{
+	return new std::thread(entry, user_data);
+}
+
+void wait_for_thread(ThreadID thread_id)
+{
+	auto thread = (std::thread*)thread_id;
+	thread->join();
+	delete thread;
+}
+
+ThreadEvent* create_event(AllocatorObject*, int manual_reset, int initial_state, const char*)
+{
+	auto event = new ThreadEvent;
+	event->manual_reset = manual_reset != 0;
+	event->set = initial_state != 0;
+	return event;
+}
+
+void destroy_event(ThreadEvent* event, AllocatorObject*)
+{
+	delete event;
+}
+
+void reset_event(ThreadEvent* event)
+{
+	std::lock_guard<std::mutex> lock(event->mutex);
+	event->set = false;
+}
+
+void set_event(ThreadEvent* event)
+{
+	std::lock_guard<std::mutex> lock(event->mutex);
+	event->set = true;
+	event->condition.notify_all();
+}
+
+void wait_for_event(ThreadEvent* event)
+{
+	std::unique_lock<std::mutex> lock(event->mutex);
+	event->condition.wait(lock, [event] { return event->set; });
+	if (!event->manual_reset)
+		event->set = false;
+}
+
+int wait_for_event_timeout(ThreadEvent* event, unsigned timeout_ms)
+{
+	std::unique_lock<std::mutex> lock(event->mutex);
+	if (!event->condition.wait_for(lock, std::chrono::milliseconds(timeout_ms), [event] { return event->set; }))
+		return 0;
+	if (!event->manual_reset)
+		event->set = false;
+	return 1;
+}
+
+ThreadCriticalSection* create_critical_section(AllocatorObject*)
+{
+	return new ThreadCriticalSection;
+}
+
+void destroy_critical_section(ThreadCriticalSection* cs, AllocatorObject*)
+{
+	delete cs;
+}
+
+void enter_critical_section(ThreadCriticalSection* cs)
+{
+	cs->mutex.lock();
+}
+
+void leave_critical_section(ThreadCriticalSection* cs)
+{
+	cs->mutex.unlock();
+}
+
+// Render buffers
+
+// Formats encode the bits per texel, or a block compression flag and the
+// bytes per block.
+const uint32_t COMPRESSED_FORMAT_FLAG = 0x10000;
+
+struct RenderBuffer
+{
+	RenderResource resource;
+	uint32_t size;
+	uint32_t format;
+};
+
+std::mutex render_buffers_mutex;
+std::deque<RenderBuffer> render_buffers;
+std::vector<char> upload_scratch;
+
+uint32_t format(RB_ComponentType, uint8_t, uint8_t, uint8_t bit_depth_x, uint8_t bit_depth_y, uint8_t bit_depth_z, uint8_t bit_depth_w)
+{
+	return bit_depth_x + bit_depth_y + bit_depth_z + bit_depth_w;
+}
+
+uint32_t compressed_format(RB_CompressedFormat compression)
+{
+	return COMPRESSED_FORMAT_FLAG | (compression == RB_BLOCK_COMPRESSED_1 || compression == RB_BLOCK_COMPRESSED_4 ? 8 : 16);
+}
+
+uint32_t create_buffer(uint32_t size, RB_Validity, RB_View view, const void* view_data, const void*)
+{
+	std::lock_guard<std::mutex> lock(render_buffers_mutex);
+	RenderBuffer buffer = {};
+	buffer.resource.handle = (unsigned)render_buffers.size();
+	buffer.size = size;
+	if (view == RB_TEXTURE_BUFFER_VIEW) {
+		auto texture_view = (const RB_TextureBufferView*)view_data;
+		buffer.format = texture_view->format;
+	}
+	render_buffers.push_back(buffer);
+	engine_counters.created_buffer_bytes += size;
+	engine_counters.live_buffer_bytes += size;
+	return buffer.resource.handle;
+}
+
+void destroy_buffer(uint32_t handle)
+{
+	std::lock_guard<std::mutex> lock(render_buffers_mutex);
+	engine_counters.live_buffer_bytes -= render_buffers[handle].size;
+}
+
+RenderResource* lookup_resource(uint32_t handle)
+{
+	std::lock_guard<std::mutex> lock(render_buffers_mutex);
+	return &render_buffers[handle].resource;
+}
+
+/**
+ * Copies uploaded data to scratch memory, standing in for the copy the
+ * driver makes of it.
+ */
+void copy_upload(const void* data, size_t size)
+{
+	if (upload_scratch.size() < size)
+		upload_scratch.resize(size);
+	memcpy(upload_scratch.data(), data, size);
+	engine_counters.uploaded_bytes += size;
+	++engine_counters.uploads;
+}
+
+void update_buffer(uint32_t, uint32_t size, const void* data)
+{
+	std::lock_guard<std::mutex> lock(render_buffers_mutex);
+	copy_upload(data, size);
+}
+
+void partial_update_texture(uint32_t handle, uint32_t, uint32_t, uint32_t, uint32_t[3], uint32_t size[3], const void* data)
+{
+	std::lock_guard<std::mutex> lock(render_buffers_mutex);
+	const auto format = render_buffers[handle].format;
+	size_t bytes;
+	if (format & COMPRESSED_FORMAT_FLAG)
+		bytes = (size_t)((size[0] + 3) / 4) * ((size[1] + 3) / 4) * (format & ~COMPRESSED_FORMAT_FLAG);
+	else
+		bytes = (size_t)size[0] * size[1] * (format / 8);
+	copy_upload(data, bytes);
+}
+
+// Resources
+
+struct Resource
+{
+	std::string name;
+	uint64_t name_id;
+	std::vector<char> data;
+	std::vector<char> stream;
+	void* loaded;
+};
+
+std::map<uint64_t, Resource> resources;
+RM_ResourceTypeCallbacks gif_callbacks;
+AllocatorObject resource_allocator;
+CompileFunction gif_compile_function;
+
+void register_type_with_callbacks(const char*, RM_ResourceTypeCallbacks* callbacks)
+{
+	gif_callbacks = *callbacks;
+}
+
+Resource* find_resource(const char* name)
+{
+	auto it = resources.find(IdString64(name).id());
+	return it != resources.end() ? &it->second : nullptr;
+}
+
+int can_get(const char*, const char* name)
+{
+	auto resource = find_resource(name);
+	return resource && resource->loaded;
+}
+
+void* get(const char*, const char* name)
+{
+	auto resource = find_resource(name);
+	return resource ? resource->loaded : nullptr;
+}
+
+int can_get_by_id(uint64_t, uint64_t name_id)
+{
+	auto it = resources.find(name_id);
+	return it != resources.end() && it->second.loaded;
+}
+
+void* get_by_id(uint64_t, uint64_t name_id)
+{
+	auto it = resources.find(name_id);
+	return it != resources.end() ? it->second.loaded : nullptr;
+}
+
+FutureInputArchive* new_open_stream_by_id(AllocatorObject*, uint64_t, uint64_t name_id)
+{
+	const auto& resource = resources.at(name_id);
+	auto future_archive = new FutureInputArchive;
+	future_archive->stream.data = resource.stream.data();
+	future_archive->stream.size = (int64_t)resource.stream.size();
+	future_archive->stream.position = 0;
+	return future_archive;
+}
+
+void delete_stream(FutureInputArchive* future_archive, AllocatorObject*)
+{
+	delete future_archive;
+}
+
+int ready(FutureInputArchive*)
+{
+	return 1;
+}
+
+void cancel(FutureInputArchive*) {}
+
+InputArchive* new_archive(FutureInputArchive* future_archive, AllocatorObject*)
+{
+	auto archive = new InputArchive;
+	archive->stream = future_archive->stream;
+	return archive;
+}
+
+void delete_archive(InputArchive* archive, AllocatorObject*)
+{
+	delete archive;
+}
+
+void archive_read(InputArchive* archive, void* buffer, unsigned size)
+{
+	auto& stream = archive->stream;
+	memcpy(buffer, stream.data + stream.position, size);
+	stream.position += size;
+}
+
+int64_t archive_size(InputArchive* archive)
+{
+	return archive->stream.size;
+}
+
+InputBuffer* archive_buffer(InputArchive* archive)
+{
+	return (InputBuffer*)archive;
+}
+
+unsigned buffer_available(InputBuffer* buffer)
+{
+	return (unsigned)(buffer->stream.size - buffer->stream.position);
+}
+
+void buffer_consume(InputBuffer* buffer, unsigned bytes)
+{
+	buffer->stream.position += bytes;
+}
+
+void* buffer_ptr(InputBuffer* buffer)
+{
+	return (void*)(buffer->stream.data + buffer->stream.position);
+}
+
+void buffer_set_position(InputBuffer* buffer, int64_t offset)
+{
+	buffer->stream.position = offset;
+}
+
+void buffer_set_read_chunk(InputBuffer*, unsigned) {}
+void buffer_flush(InputBuffer*, unsigned) {}
+
+int buffer_can_flush_without_stalling(InputBuffer*)
+{
+	return 1;
+}
+
+// Data compiler
+
+void add_compiler(const char*, unsigned, CompileFunction compile)
+{
+	gif_compile_function = compile;
+}
+
+const char* source_path(DataCompileParameters* input)
+{
+	return input->source_path;
+}
+
+const char* destination_platform(DataCompileParameters* input)
+{
+	return input->platform;
+}
+
+DataCompileResult read(DataCompileParameters* input)
+{
+	DataCompileResult result = {};
+	result.data.len = (unsigned)input->source->size();
+	result.data.p = (char*)allocate(input->allocator, result.data.len, 16);
+	memcpy(result.data.p, input->source->data(), result.data.len);
+	deallocate(input->allocator, input->read_data);
+	input->read_data = result.data.p;
+	return result;
+}
+
+AllocatorObject* compile_allocator(DataCompileParameters* input)
+{
+	return input->allocator;
+}
+
+// Units
+
+std::vector<CApiUnit*> units;
+
+CApiUnitRef reference(CApiUnit* unit)
+{
+	return unit->ref;
+}
+
+CApiUnit* dereference(CApiUnitRef ref)
+{
+	return ref < units.size() ? units[ref] : nullptr;
+}
+
+uint64_t unit_resource_name(CApiUnit* unit)
+{
+	return unit->resource_name;
+}
+
+unsigned num_meshes(UnitRef ref)
+{
+	return (unsigned)units[ref]->meshes.size();
+}
+
+MeshPtr mesh(UnitRef ref, unsigned index, const char*)
+{
+	return &units[ref]->meshes[index];
+}
+
+unsigned num_materials(ConstMeshPtr)
+{
+	return 1;
+}
+
+unsigned find_material(ConstMeshPtr, unsigned)
+{
+	return 0;
+}
+
+MaterialPtr material(MeshPtr mesh, unsigned)
+{
+	return &mesh->material;
+}
+
+BoundingVolumeWrapper bounding_volume(MeshPtr)
+{
+	BoundingVolumeWrapper bounds = {};
+	bounds.min.x = bounds.min.y = bounds.min.z = -1.0f;
+	bounds.max.x = bounds.max.y = bounds.max.z = 1.0f;
+	bounds.radius = 1.7320508f;
+	return bounds;
+}
+
+ConstMatrix4x4Ptr world_pose(ConstMeshPtr mesh)
+{
+	return &mesh->pose;
+}
+
+void set_resource(MaterialPtr material, unsigned slot_name_id32, ConstRenderResourcePtr render_resource)
+{
+	material->resources[slot_name_id32] = render_resource;
+	++engine_counters.material_updates;
+}
+
+void set_scalar(MaterialPtr material, unsigned variable_name_id32, float value)
+{
+	material->scalars[variable_name_id32] = value;
+	++engine_counters.material_updates;
+}
+
+/**
+ * Returns the script data value named by the first identifier, nested
+ * script data not being used by the plugin.
+ */
+const ScriptDataValue* script_data_value(UnitRef ref, unsigned num_identifiers, va_list identifiers)
+{
+	if (num_identifiers != 1 || ref >= units.size())
+		return nullptr;
+	const auto& script_data = units[ref]->script_data;
+	auto it = script_data.find(va_arg(identifiers, const char*));
+	return it != script_data.end() ? &it->second : nullptr;
+}
+
+int has_data(UnitRef ref, unsigned num_identifiers, ...)
+{
+	va_list identifiers;
+	va_start(identifiers, num_identifiers);
+	auto value = script_data_value(ref, num_identifiers, identifiers);
+	va_end(identifiers);
+	return value != nullptr;
+}
+
+DynamicScriptDataItem get_data(UnitRef ref, unsigned num_identifiers, ...)
+{
+	va_list identifiers;
+	va_start(identifiers, num_identifiers);
+	auto value = script_data_value(ref, num_identifiers, identifiers);
+	va_end(identifiers);
+
+	DynamicScriptDataItem item = { nullptr, D_DATA_NIL_TYPE, 0 };
+	if (value == nullptr)
+		return item;
+	item.type = value->type;
+	if (value->type == D_DATA_STRING_TYPE) {
+		item.pointer = value->string.c_str();
+		item.size = (unsigned)value->string.size() + 1;
+	} else if (value->type == D_DATA_NUMBER_TYPE) {
+		item.pointer = &value->number;
+		item.size = sizeof(value->number);
+	} else {
+		item.pointer = &value->boolean;
+		item.size = sizeof(value->boolean);
+	}
+	return item;
+}
+
+void set_string(CApiUnit* unit, const char* name, const char* value)
+{
+	if (value == nullptr)
+		return;
+	auto& data = unit->script_data[name];
+	data.type = D_DATA_STRING_TYPE;
+	data.string = value;
+}
+
+// Lua and Flow, which functions the benchmark does not call.
+
+void add_module_function(const char*, const char*, lua_CFunction) {}
+void add_console_command(const char*, lua_CFunction, const char*, ...) {}
+void remove_all_module_entries(const char*) {}
+void deprecated_error(const char*, const char*, const char*) {}
+void setup_trigger_function(unsigned, FlowFunction) {}
+void unregister_flow_node(unsigned) {}
+void trigger_out_event(FlowTriggerContext*, const FlowData*, int) {}
+void trigger_external_unit_event(CApiUnit*, unsigned) {}
+
+}
+
+void* get_engine_api(unsigned api)
+{
+	static AllocatorApi allocator_api;
+	static LoggingApi logging_api;
+	static ErrorApi error_api;
+	static ProfilerApi profiler_api;
+	static TimerApi timer_api;
+	static ThreadApi thread_api;
+	static RenderBufferApi render_buffer_api;
+	static ResourceManagerApi resource_manager_api;
+	static FutureInputArchiveApi future_input_archive_api;
+	static InputArchiveApi input_archive_api;
+	static InputBufferApi input_buffer_api;
+	static DataCompilerApi data_compiler_api;
+	static DataCompileParametersApi data_compile_parameters_api;
+	static UnitApi unit_api;
+	static UnitReferenceApi unit_reference_api;
+	static LuaApi lua_api;
+	static FlowNodesApi flow_nodes_api;
+	static UnitCApi unit_c_api;
+	static MeshCApi mesh_c_api;
+	static MaterialCApi material_c_api;
+	static DynamicScriptDataUnitApi dynamic_script_data_unit_api;
+	static DynamicScriptDataCApi dynamic_script_data_c_api;
+	static ScriptApi script_api;
+
+	switch (api) {
+	case ALLOCATOR_API_ID:
+		allocator_api.make_plugin_allocator = make_plugin_allocator;
+		allocator_api.destroy_plugin_allocator = destroy_plugin_allocator;
+		allocator_api.allocate = allocate;
+		allocator_api.deallocate = deallocate;
+		return &allocator_api;
+	case LOGGING_API_ID:
+		logging_api.info = log_info;
+		logging_api.warning = log_warning;
+		return &logging_api;
+	case ERROR_API_ID:
+		error_api.eprintf = eprintf;
+		return &error_api;
+	case PROFILER_API_ID:
+		profiler_api.profile_start = profile_start;
+		profiler_api.profile_stop = profile_stop;
+		profiler_api.make_thread_profiler = make_thread_profiler;
+		profiler_api.delete_thread_profiler = delete_thread_profiler;
+		return &profiler_api;
+	case TIMER_API_ID:
+		timer_api.ticks = ticks;
+		timer_api.ticks_to_seconds = ticks_to_seconds;
+		return &timer_api;
+	case THREAD_API_ID:
+		thread_api.create_thread = create_thread;
+		thread_api.wait_for_thread = wait_for_thread;
+		thread_api.create_event = create_event;
+		thread_api.destroy_event = destroy_event;
+		thread_api.reset_event = reset_event;
+		thread_api.set_event = set_event;
+		thread_api.wait_for_event = wait_for_event;
+		thread_api.wait_for_event_timeout = wait_for_event_timeout;
+		thread_api.create_critical_section = create_critical_section;
+		thread_api.destroy_critical_section = destroy_critical_section;
+		thread_api.enter_critical_section = enter_critical_section;
+		thread_api.leave_critical_section = leave_critical_section;
+		return &thread_api;
+	case RENDER_BUFFER_API_ID:
+		render_buffer_api.format = format;
+		render_buffer_api.compressed_format = compressed_format;
+		render_buffer_api.create_buffer = create_buffer;
+		render_buffer_api.update_buffer = update_buffer;
+		render_buffer_api.destroy_buffer = destroy_buffer;
+		render_buffer_api.lookup_resource = lookup_resource;
+		render_buffer_api.partial_update_texture = partial_update_texture;
+		return &render_buffer_api;
+	case RESOURCE_MANAGER_API_ID:
+		resource_manager_api.register_type_with_callbacks = register_type_with_callbacks;
+		resource_manager_api.can_get = can_get;
+		resource_manager_api.get = get;
+		resource_manager_api.can_get_by_id = can_get_by_id;
+		resource_manager_api.get_by_id = get_by_id;
+		resource_manager_api.new_open_stream_by_id = new_open_stream_by_id;
+		resource_manager_api.delete_stream = delete_stream;
+		return &resource_manager_api;
+	case FUTURE_INPUT_ARCHIVE_API_ID:
+		future_input_archive_api.ready = ready;
+		future_input_archive_api.cancel = cancel;
+		future_input_archive_api.new_archive = new_archive;
+		future_input_archive_api.delete_archive = delete_archive;
+		return &future_input_archive_api;
+	case INPUT_ARCHIVE_API_ID:
+		input_archive_api.read = archive_read;
+		input_archive_api.size = archive_size;
+		input_archive_api.buffer = archive_buffer;
+		return &input_archive_api;
+	case INPUT_BUFFER_API_ID:
+		input_buffer_api.available = buffer_available;
+		input_buffer_api.consume = buffer_consume;
+		input_buffer_api.ptr = buffer_ptr;
+		input_buffer_api.set_position = buffer_set_position;
+		input_buffer_api.set_read_chunk = buffer_set_read_chunk;
+		input_buffer_api.flush = buffer_flush;
+		input_buffer_api.can_flush_without_stalling = buffer_can_flush_without_stalling;
+		return &input_buffer_api;
+	case DATA_COMPILER_API_ID:
+		data_compiler_api.add_compiler = add_compiler;
+		return &data_compiler_api;
+	case DATA_COMPILE_PARAMETERS_API_ID:
+		data_compile_parameters_api.source_path = source_path;
+		data_compile_parameters_api.destination_platform = destination_platform;
+		data_compile_parameters_api.read = read;
+		data_compile_parameters_api.allocator = compile_allocator;
+		return &data_compile_parameters_api;
+	case UNIT_API_ID:
+		unit_api.reference = reference;
+		unit_api.unit_resource_name = unit_resource_name;
+		return &unit_api;
+	case UNIT_REFERENCE_API_ID:
+		unit_reference_api.dereference = dereference;
+		return &unit_reference_api;
+	case LUA_API_ID:
+		lua_api.add_module_function = add_module_function;
+		lua_api.add_console_command = add_console_command;
+		lua_api.remove_all_module_entries = remove_all_module_entries;
+		lua_api.deprecated_error = deprecated_error;
+		return &lua_api;
+	case FLOW_NODES_API_ID:
+		flow_nodes_api.setup_trigger_function = setup_trigger_function;
+		flow_nodes_api.unregister_flow_node = unregister_flow_node;
+		flow_nodes_api.trigger_out_event = trigger_out_event;
+		flow_nodes_api.trigger_external_unit_event = trigger_external_unit_event;
+		return &flow_nodes_api;
+	case C_API_ID:
+		unit_c_api.num_meshes = num_meshes;
+		unit_c_api.mesh = mesh;
+		mesh_c_api.num_materials = num_materials;
+		mesh_c_api.find_material = find_material;
+		mesh_c_api.material = material;
+		mesh_c_api.bounding_volume = bounding_volume;
+		mesh_c_api.world_pose = world_pose;
+		material_c_api.set_resource = set_resource;
+		material_c_api.set_scalar = set_scalar;
+		dynamic_script_data_unit_api.has_data = has_data;
+		dynamic_script_data_unit_api.get_data = get_data;
+		dynamic_script_data_c_api.Unit = &dynamic_script_data_unit_api;
+		script_api.Unit = &unit_c_api;
+		script_api.Mesh = &mesh_c_api;
+		script_api.Material = &material_c_api;
+		script_api.DynamicScriptData = &dynamic_script_data_c_api;
+		return &script_api;
+	}
+	return nullptr;
+}
+
+void set_verbose(bool enabled)
+{
+	verbose = enabled;
+}
+
+const char* compile_gif_resource(const char* name, const char* source_path, const std::vector<char>& source, const char* platform)
+{
+	DataCompileParameters input = { source_path, &source, platform, &resource_allocator, nullptr };
+	auto result = gif_compile_function(&input);
+	deallocate(&resource_allocator, input.read_data);
+	if (result.error)
+		return result.error;
+
+	// Keep the compiled data as the data compiler would write it out.
+	const auto name_id = IdString64(name).id();
+	auto& resource = resources[name_id];
+	resource.name = name;
+	resource.name_id = name_id;
+	resource.data.assign(result.data.p, result.data.p + result.data.len);
+	resource.stream.assign(result.stream.p, result.stream.p + result.stream.len);
+	resource.loaded = nullptr;
+	deallocate(&resource_allocator, result.data.p);
+	deallocate(&resource_allocator, result.stream.p);
+	return nullptr;
+}
+
+void load_resources()
+{
+	for (auto& it : resources) {
+		auto& resource = it.second;
+		InputArchive archive = { { resource.data.data(), (int64_t)resource.data.size(), 0 } };
+		resource.loaded = gif_callbacks.load(nullptr, resource.name_id, &archive, &resource_allocator, nullptr);
+		gif_callbacks.bring_in(nullptr, resource.loaded);
+	}
+}
+
+void unload_resources()
+{
+	for (auto& it : resources) {
+		auto& resource = it.second;
+		if (resource.loaded == nullptr)
+			continue;
+		gif_callbacks.bring_out(nullptr, resource.loaded);
+		gif_callbacks.destroy(nullptr, resource.loaded, &resource_allocator, nullptr);
+		resource.loaded = nullptr;
+	}
+}
+
+CApiUnit* make_unit(const UnitDescription& description)
+{
+	auto unit = new CApiUnit;
+	unit->ref = (CApiUnitRef)units.size();
+	unit->resource_name = description.unit_resource_name;
+	unit->meshes.resize(description.mesh_count);
+	for (auto& mesh : unit->meshes) {
+		memset(&mesh.pose, 0, sizeof(mesh.pose));
+		mesh.pose.v[0] = mesh.pose.v[5] = mesh.pose.v[10] = mesh.pose.v[15] = 1.0f;
+	}
+	units.push_back(unit);
+
+	set_string(unit, "giphy_resource", description.giphy_resource);
+	set_string(unit, "giphy_material_slot_name", description.material_slot_name);
+	set_string(unit, "giphy_palette_slot_name", description.palette_slot_name);
+	set_string(unit, "giphy_frame_index_variable", description.frame_index_variable);
+
+	// Show the giphy on all the unit meshes.
+	std::string targets;
+	for (unsigned i = 0; i < description.mesh_count; ++i)
+		targets += std::to_string(i) + " ";
+	set_string(unit, "giphy_targets", targets.c_str());
+	if (description.shared_clock) {
+		auto& data = unit->script_data["giphy_shared_clock"];
+		data.type = D_DATA_BOOLEAN_TYPE;
+		data.boolean = 1;
+	}
+	return unit;
+}
+
+void destroy_unit(CApiUnit* unit)
+{
+	units[unit->ref] = nullptr;
+	delete unit;
+}
+
+std::vector<ProfileScopeTime> profile_scope_times()
+{
+	std::lock_guard<std::mutex> lock(scope_times_mutex);
+	std::vector<ProfileScopeTime> times;
+	for (const auto& it : scope_times)
+		times.push_back(it.second);
+	return times;
+}
+
+void reset_profile_scope_times()
+{
+	std::lock_guard<std::mutex> lock(scope_times_mutex);
+	scope_times.clear();
+}
+
+}
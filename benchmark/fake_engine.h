@@ -0,0 +1,80 @@
+#pragma once
+
+#include <engine_plugin_api/plugin_api.h>
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace giphy_benchmark {
+
+/**
+ * Work submitted by the plugin to the stand-in engine. Uploads get counted
+ * when executed, on whichever thread executes them.
+ */
+struct EngineCounters
+{
+	std::atomic<uint64_t> uploaded_bytes;
+	std::atomic<uint64_t> uploads;
+	std::atomic<uint64_t> created_buffer_bytes;
+	std::atomic<uint64_t> live_buffer_bytes;
+	std::atomic<uint64_t> material_updates;
+	std::atomic<uint64_t> plugin_memory;
+	std::atomic<uint64_t> peak_plugin_memory;
+};
+extern EngineCounters engine_counters;
+
+/**
+ * Returns the stand-in engine APIs, as the engine passes them to the plugin.
+ */
+void* get_engine_api(unsigned api);
+
+/**
+ * Silences the plugin info logs, warnings are always printed.
+ */
+void set_verbose(bool verbose);
+
+/**
+ * Compiles GIF source data with the compiler registered by the plugin, and
+ * adds the result as a resource named `name`. Returns an error message, or
+ * null on success.
+ */
+const char* compile_gif_resource(const char* name, const char* source_path, const std::vector<char>& source, const char* platform);
+
+/**
+ * Loads and brings in all compiled resources, and the opposite.
+ */
+void load_resources();
+void unload_resources();
+
+/**
+ * Script data and meshes of a stand-in unit.
+ */
+struct UnitDescription
+{
+	const char* giphy_resource;
+	const char* material_slot_name;
+	const char* palette_slot_name;
+	const char* frame_index_variable;
+	bool shared_clock;
+	unsigned mesh_count;
+	uint64_t unit_resource_name;
+};
+
+CApiUnit* make_unit(const UnitDescription& description);
+void destroy_unit(CApiUnit* unit);
+
+/**
+ * Accumulated time spent in each profiler scope opened by the plugin.
+ */
+struct ProfileScopeTime
+{
+	std::string name;
+	double seconds;
+	uint64_t count;
+};
+std::vector<ProfileScopeTime> profile_scope_times();
+void reset_profile_scope_times();
+
+}
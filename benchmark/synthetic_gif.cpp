@@ -0,0 +1,166 @@
+#include "synthetic_gif.h"
+
+#include <stdint.h>
+
+namespace giphy_benchmark {
+
+namespace {
+
+const unsigned MIN_CODE_SIZE = 8;
+const unsigned CLEAR_CODE = 1 << MIN_CODE_SIZE;
+const unsigned END_CODE = CLEAR_CODE + 1;
+
+// Literal codes stay 9 bits wide if the table gets cleared before the
+// decoder adds its 254th entry.
+const unsigned LITERALS_PER_CLEAR = 253;
+
+const unsigned TRANSPARENT_INDEX = 0;
+const unsigned FRAME_DELAY = 4;
+
+void write_u8(std::vector<char>& out, unsigned value)
+{
+	out.push_back((char)(value & 0xff));
+}
+
+void write_u16(std::vector<char>& out, unsigned value)
+{
+	write_u8(out, value);
+	write_u8(out, value >> 8);
+}
+
+/**
+ * Packs 9 bit LZW codes in sub-blocks of at most 255 bytes.
+ */
+struct CodeWriter
+{
+	std::vector<char>& out;
+	std::vector<char> block;
+	uint32_t bits;
+	unsigned bit_count;
+
+	explicit CodeWriter(std::vector<char>& o) : out(o), bits(0), bit_count(0) {}
+
+	void write(unsigned code)
+	{
+		bits |= code << bit_count;
+		bit_count += MIN_CODE_SIZE + 1;
+		while (bit_count >= 8) {
+			push(bits & 0xff);
+			bits >>= 8;
+			bit_count -= 8;
+		}
+	}
+
+	void push(unsigned byte)
+	{
+		block.push_back((char)byte);
+		if (block.size() == 255)
+			flush_block();
+	}
+
+	void flush_block()
+	{
+		if (block.empty())
+			return;
+		write_u8(out, (unsigned)block.size());
+		out.insert(out.end(), block.begin(), block.end());
+		block.clear();
+	}
+
+	void finish()
+	{
+		if (bit_count > 0)
+			push(bits & 0xff);
+		flush_block();
+		write_u8(out, 0);
+	}
+};
+
+/**
+ * Returns the palette index of a pixel of a frame.
+ */
+unsigned pixel_index(unsigned x, unsigned y, unsigned frame, unsigned width, unsigned height, unsigned frame_count)
+{
+	const unsigned square_size = (width < height ? width : height) / 4 + 1;
+	const unsigned square_x = (width - square_size) * frame / frame_count;
+	const unsigned square_y = (height - square_size) / 2;
+	if (x >= square_x && x < square_x + square_size && y >= square_y && y < square_y + square_size)
+		return 255;
+	return 1 + ((x / 8 + y / 8) % 2) * 127;
+}
+
+}
+
+std::vector<char> make_synthetic_gif(unsigned width, unsigned height, unsigned frame_count, bool transparent)
+{
+	std::vector<char> out;
+	const char header[] = "GIF89a";
+	out.insert(out.end(), header, header + 6);
+
+	// Logical screen with a 256 colors global palette.
+	write_u16(out, width);
+	write_u16(out, height);
+	write_u8(out, 0xf7);
+	write_u8(out, 0);
+	write_u8(out, 0);
+	for (unsigned i = 0; i < 256; ++i) {
+		write_u8(out, i);
+		write_u8(out, (i * 7) & 0xff);
+		write_u8(out, 255 - i);
+	}
+
+	// Loop forever.
+	const char netscape[] = "NETSCAPE2.0";
+	write_u8(out, 0x21);
+	write_u8(out, 0xff);
+	write_u8(out, 11);
+	out.insert(out.end(), netscape, netscape + 11);
+	write_u8(out, 3);
+	write_u8(out, 1);
+	write_u16(out, 0);
+	write_u8(out, 0);
+
+	for (unsigned f = 0; f < frame_count; ++f) {
+		// Graphic control extension, restoring the background of transparent frames.
+		write_u8(out, 0x21);
+		write_u8(out, 0xf9);
+		write_u8(out, 4);
+		write_u8(out, transparent ? (2 << 2) | 1 : (1 << 2));
+		write_u16(out, FRAME_DELAY);
+		write_u8(out, TRANSPARENT_INDEX);
+		write_u8(out, 0);
+
+		// Full frame image descriptor using the global palette.
+		write_u8(out, 0x2c);
+		write_u16(out, 0);
+		write_u16(out, 0);
+		write_u16(out, width);
+		write_u16(out, height);
+		write_u8(out, 0);
+
+		write_u8(out, MIN_CODE_SIZE);
+		CodeWriter codes(out);
+		codes.write(CLEAR_CODE);
+		unsigned literals = 0;
+		for (unsigned y = 0; y < height; ++y) {
+			for (unsigned x = 0; x < width; ++x) {
+				if (literals == LITERALS_PER_CLEAR) {
+					codes.write(CLEAR_CODE);
+					literals = 0;
+				}
+				auto index = pixel_index(x, y, f, width, height, frame_count);
+				if (transparent && index != 255)
+					index = TRANSPARENT_INDEX;
+				codes.write(index);
+				++literals;
+			}
+		}
+		codes.write(END_CODE);
+		codes.finish();
+	}
+
+	write_u8(out, 0x3b);
+	return out;
+}
+
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <vector>
+
+namespace giphy_benchmark {
+
+/**
+ * Writes an animated GIF of `frame_count` frames, showing a square moving
+ * over a static background, so consecutive frames differ in part only.
+ * Transparent GIFs key out the background.
+ */
+std::vector<char> make_synthetic_gif(unsigned width, unsigned height, unsigned frame_count, bool transparent);
+
+}
@@ -1,11 +1,18 @@
 
 #include <editor_plugin_api/editor_plugin_api.h>
+#include <gif_decoder.h>
+
+#include <stdio.h>
+#include <stdlib.h>
 #include <string>
+#include <vector>
+#if defined(_WIN32)
+	#include <malloc.h>
+#endif
 
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #define STBI_ONLY_PNG
-#define STBI_ONLY_GIF
 
 #include <stb_image.h>
 #include <stb_image_write.h>
@@ -124,91 +131,68 @@ size_t test_custom_deallocate(void* ptr, void *param)
 
 
 /**
-* Load GIF animations frames from the specified file path..
-*/
-STBIDEF unsigned char *gif_load_frames(char const *filename, int *x, int *y, int *frames)
+ * Allocator of the GIF decoder memory, released when done extracting frames.
+ */
+class HeapAllocator : public stingray_plugin_foundation::Allocator
 {
-	typedef struct gif_result_t {
-		int delay;
-		unsigned char *data;
-		struct gif_result_t *next;
-	} gif_result;
-
-	FILE *f;
-	stbi__context s;
-	unsigned char *result;
-
-	if (!((f = stbi__fopen(filename, "rb"))))
-		return stbi__errpuc("can't fopen", "Unable to open file");
-
-	stbi__start_file(&s, f);
-
-	if (stbi__gif_test(&s)) {
-		int c;
-		stbi__gif g;
-		gif_result head;
-		gif_result *prev = nullptr, *gr = &head;
-
-		memset(&g, 0, sizeof(g));
-		memset(&head, 0, sizeof(head));
-
-		*frames = 0;
-
-		while ((gr->data = stbi__gif_load_next(&s, &g, &c, 4))) {
-			if (gr->data == (unsigned char*)&s) {
-				gr->data = nullptr;
-				break;
-			}
-
-			if (prev) prev->next = gr;
-			gr->delay = g.delay;
-			prev = gr;
-			gr = (gif_result*)stbi__malloc(sizeof(gif_result));
-			memset(gr, 0, sizeof(gif_result));
-			++(*frames);
-		}
-
-		STBI_FREE(g.out);
-
-		if (gr != &head)
-			STBI_FREE(gr);
+public:
+	void* allocate(size_t size, unsigned align = DEFAULT_ALIGN) override
+	{
+		#if defined(_WIN32)
+			return _aligned_malloc(size, align);
+		#else
+			// aligned_alloc wants a size multiple of the alignment.
+			return aligned_alloc(align, (size + align - 1) / align * align);
+		#endif
+	}
 
-		if (*frames > 0) {
-			*x = g.w;
-			*y = g.h;
-		}
+	size_t deallocate(void* p) override
+	{
+		#if defined(_WIN32)
+			_aligned_free(p);
+		#else
+			free(p);
+		#endif
+		return 0;
+	}
+};
 
-		result = head.data;
+/**
+* Read all the bytes of a file.
+*/
+bool read_file(const char* filename, std::vector<unsigned char>& data)
+{
+	auto f = fopen(filename, "rb");
+	if (f == nullptr)
+		return false;
+	fseek(f, 0, SEEK_END);
+	data.resize((size_t)ftell(f));
+	fseek(f, 0, SEEK_SET);
+	const bool read = fread(data.data(), 1, data.size(), f) == data.size();
+	fclose(f);
+	return read;
+}
 
-		if (*frames > 1) {
-			unsigned int size = 4 * g.w * g.h;
-			unsigned char *p;
+/**
+* Save a frame to disk as a PNG file named after the GIF file and frame index.
+*/
+void write_frame(const std::string& file_path, int index, int w, int h, const unsigned char* pixels, unsigned delay, std::vector<std::string>& png_filenames)
+{
+	char png_filename[256];
 
-			result = (unsigned char*)stbi__malloc(*frames * (size + 2));
-			gr = &head;
-			p = result;
+	size_t dot_index = file_path.find_last_of(".");
+	auto raw_name = file_path.substr(0, dot_index);
 
-			while (gr) {
-				prev = gr;
-				memcpy(p, gr->data, size);
-				p += size;
-				*p++ = gr->delay & 0xFF;
-				*p++ = (gr->delay & 0xFF00) >> 8;
-				gr = gr->next;
+	sprintf(png_filename, "%s_%02d.png", raw_name.c_str(), index);
+	auto image_written = stbi_write_png(png_filename, w, h, 4, pixels, 0);
+	if (!image_written)
+		return;
 
-				STBI_FREE(prev->data);
-				if (prev != &head) STBI_FREE(prev);
-			}
-		}
-	}
-	else {
-		stbi__result_info result_info;
-		result = (unsigned char*)stbi__load_main(&s, x, y, frames, 4, &result_info, 0);
-		*frames = !!result;
-	}
+	char generation_log_info[1024];
+	sprintf(generation_log_info, "Generated `%s` with frame delay %u", png_filename, delay);
+	logging_api->info(generation_log_info);
 
-	fclose(f);
-	return result;
+	png_filenames.push_back(png_filename);
 }
 
 /**
@@ -221,33 +205,38 @@ ConfigValue extract_frames(ConfigValueArgs args, int num)
 	auto file_path_cv = &args[0];
 	std::string file_path = config_data_api->to_string(file_path_cv);
 
-	int w, h, frames;
-	auto frames_data = gif_load_frames(file_path.c_str(), &w, &h, &frames);
+	std::vector<unsigned char> file_data;
+	std::vector<std::string> png_filenames;
+	HeapAllocator allocator;
+	GifDecoder decoder(allocator);
+	if (!read_file(file_path.c_str(), file_data))
+		file_data.clear();
+
+	// Other images get extracted as a single frame.
+	if (!file_data.empty() && !decoder.open(file_data.data(), (unsigned)file_data.size())) {
+		int w, h, channels;
+		auto pixels = stbi_load_from_memory(file_data.data(), (int)file_data.size(), &w, &h, &channels, 4);
+		if (pixels) {
+			write_frame(file_path, 0, w, h, pixels, 0, png_filenames);
+			stbi_image_free(pixels);
+		}
+		file_data.clear();
+	}
+
+	// Decode each frame in place over the previous one, writing it out before
+	// decoding the next.
+	const int w = (int)decoder.width(), h = (int)decoder.height();
+	std::vector<unsigned char> frame_data((size_t)w * h * 4);
+	unsigned short delay = 0;
+	for (int i = 0; !file_data.empty() && decoder.next_frame(frame_data.data(), i > 0 ? frame_data.data() : nullptr, delay); ++i)
+		write_frame(file_path, i, w, h, frame_data.data(), delay, png_filenames);
 
 	// Create config data array to return all generated PNG file paths.
 	auto result_file_paths = config_data_api->make(nullptr);
-	config_data_api->set_array(result_file_paths, frames);
-
-	unsigned int frame_size = 4 * w * h;
-	for (int i = 0; i < frames; ++i) {
-		char png_filename[256];
-		auto frame_data = frames_data + i * (frame_size + 2);
-		auto delay = (stbi__uint16)*(frame_data + frame_size);
-
-		size_t dot_index = file_path.find_last_of(".");
-		auto raw_name = file_path.substr(0, dot_index);
-
-		sprintf(png_filename, "%s_%02d.png", raw_name.c_str(), i);
-		auto image_written = stbi_write_png(png_filename, w, h, 4, frame_data, 0);
-		if (!image_written)
-			continue;
-
-		char generation_log_info[1024];
-		sprintf(generation_log_info, "Generated `%s` with frame delay %d", png_filename, delay);
-		logging_api->info(generation_log_info);
-
+	config_data_api->set_array(result_file_paths, (int)png_filenames.size());
+	for (int i = 0; i < (int)png_filenames.size(); ++i) {
 		auto file_path_item = config_data_api->array_item(result_file_paths, i);
-		config_data_api->set_string(file_path_item, png_filename);
+		config_data_api->set_string(file_path_item, png_filenames[i].c_str());
 	}
 
 	return result_file_paths;
@@ -0,0 +1,170 @@
+#include "block_encoder.h"
+
+#include <string.h>
+
+namespace PLUGIN_NAMESPACE {
+
+namespace {
+
+unsigned short pack_565(const int* rgb)
+{
+	return (unsigned short)(((rgb[0] >> 3) << 11) | ((rgb[1] >> 2) << 5) | (rgb[2] >> 3));
+}
+
+void unpack_565(unsigned short color, int* rgb)
+{
+	const int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+void write_u16(unsigned char* dest, unsigned short value)
+{
+	dest[0] = (unsigned char)value;
+	dest[1] = (unsigned char)(value >> 8);
+}
+
+/**
+ * Encodes the colors of a block of 16 R8G8B8A8 pixels using the bounding box
+ * diagonal that best follows the colors distribution as end points.
+ */
+void compress_color_block(const unsigned char* block, unsigned char* dest)
+{
+	int min[3] = { 255, 255, 255 }, max[3] = { 0, 0, 0 };
+	for (unsigned i = 0; i < 16; ++i) {
+		for (unsigned c = 0; c < 3; ++c) {
+			const int v = block[i * 4 + c];
+			min[c] = v < min[c] ? v : min[c];
+			max[c] = v > max[c] ? v : max[c];
+		}
+	}
+
+	// Pick the diagonal matching how red and blue vary with green.
+	int center[3], cov_rg = 0, cov_bg = 0;
+	for (unsigned c = 0; c < 3; ++c)
+		center[c] = (min[c] + max[c]) / 2;
+	for (unsigned i = 0; i < 16; ++i) {
+		const int dg = block[i * 4 + 1] - center[1];
+		cov_rg += (block[i * 4 + 0] - center[0]) * dg;
+		cov_bg += (block[i * 4 + 2] - center[2]) * dg;
+	}
+
+	// Inset the end points to reduce the error of the colors between them.
+	for (unsigned c = 0; c < 3; ++c) {
+		const int inset = (max[c] - min[c]) >> 4;
+		min[c] += inset;
+		max[c] -= inset;
+	}
+	if (cov_rg < 0) { int t = min[0]; min[0] = max[0]; max[0] = t; }
+	if (cov_bg < 0) { int t = min[2]; min[2] = max[2]; max[2] = t; }
+
+	// The first end point must be greater to select the four colors mode.
+	unsigned short color0 = pack_565(max), color1 = pack_565(min);
+	if (color0 < color1) {
+		unsigned short t = color0; color0 = color1; color1 = t;
+	}
+
+	write_u16(dest, color0);
+	write_u16(dest + 2, color1);
+	memset(dest + 4, 0, 4);
+	if (color0 == color1)
+		return;
+
+	int palette[4][3];
+	unpack_565(color0, palette[0]);
+	unpack_565(color1, palette[1]);
+	for (unsigned c = 0; c < 3; ++c) {
+		palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+		palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+	}
+
+	unsigned indices = 0;
+	for (unsigned i = 0; i < 16; ++i) {
+		unsigned best_index = 0;
+		int best_error = 0x7fffffff;
+		for (unsigned p = 0; p < 4; ++p) {
+			const int dr = block[i * 4 + 0] - palette[p][0];
+			const int dg = block[i * 4 + 1] - palette[p][1];
+			const int db = block[i * 4 + 2] - palette[p][2];
+			const int error = dr * dr + dg * dg + db * db;
+			if (error < best_error) {
+				best_error = error;
+				best_index = p;
+			}
+		}
+		indices |= best_index << (i * 2);
+	}
+
+	for (unsigned b = 0; b < 4; ++b)
+		dest[4 + b] = (unsigned char)(indices >> (b * 8));
+}
+
+/**
+ * Encodes the alpha of a block of 16 R8G8B8A8 pixels using the eight values
+ * interpolation mode.
+ */
+void compress_alpha_block(const unsigned char* block, unsigned char* dest)
+{
+	int min = 255, max = 0;
+	for (unsigned i = 0; i < 16; ++i) {
+		const int a = block[i * 4 + 3];
+		min = a < min ? a : min;
+		max = a > max ? a : max;
+	}
+
+	dest[0] = (unsigned char)max;
+	dest[1] = (unsigned char)min;
+	memset(dest + 2, 0, 6);
+	if (max == min)
+		return;
+
+	int palette[8] = { max, min };
+	for (int p = 1; p < 7; ++p)
+		palette[p + 1] = ((7 - p) * max + p * min) / 7;
+
+	unsigned long long indices = 0;
+	for (unsigned i = 0; i < 16; ++i) {
+		unsigned best_index = 0;
+		int best_error = 256;
+		for (unsigned p = 0; p < 8; ++p) {
+			const int error = block[i * 4 + 3] > palette[p] ? block[i * 4 + 3] - palette[p] : palette[p] - block[i * 4 + 3];
+			if (error < best_error) {
+				best_error = error;
+				best_index = p;
+			}
+		}
+		indices |= (unsigned long long)best_index << (i * 3);
+	}
+
+	for (unsigned b = 0; b < 6; ++b)
+		dest[2 + b] = (unsigned char)(indices >> (b * 8));
+}
+
+/**
+ * Gathers the rows of a 4x4 block of pixels.
+ */
+void load_block(const unsigned char* pixels, unsigned stride, unsigned char* block)
+{
+	for (unsigned y = 0; y < 4; ++y)
+		memcpy(block + y * 16, pixels + y * stride, 16);
+}
+
+}
+
+void compress_bc1_block(const unsigned char* pixels, unsigned stride, unsigned char* dest)
+{
+	unsigned char block[64];
+	load_block(pixels, stride, block);
+	compress_color_block(block, dest);
+}
+
+void compress_bc3_block(const unsigned char* pixels, unsigned stride, unsigned char* dest)
+{
+	unsigned char block[64];
+	load_block(pixels, stride, block);
+	compress_alpha_block(block, dest);
+	compress_color_block(block, dest + 8);
+}
+
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+namespace PLUGIN_NAMESPACE {
+
+/**
+ * Compresses a 4x4 block of R8G8B8A8 pixels to 8 bytes of BC1. The alpha
+ * channel is ignored. `stride` is the size in bytes of a row of pixels.
+ */
+void compress_bc1_block(const unsigned char* pixels, unsigned stride, unsigned char* dest);
+
+/**
+ * Compresses a 4x4 block of R8G8B8A8 pixels to 16 bytes of BC3.
+ */
+void compress_bc3_block(const unsigned char* pixels, unsigned stride, unsigned char* dest);
+
+}
@@ -0,0 +1,104 @@
+#include "deadline_queue.h"
+
+namespace PLUGIN_NAMESPACE {
+
+using namespace stingray_plugin_foundation;
+
+const unsigned DeadlineQueue::INVALID_POSITION;
+
+DeadlineQueue::DeadlineQueue(Allocator& allocator)
+	: _heap(allocator)
+	, _positions(allocator)
+{
+}
+
+void DeadlineQueue::schedule(unsigned id, double deadline)
+{
+	while (_positions.size() <= id)
+		_positions.push_back(INVALID_POSITION);
+
+	Entry entry = { deadline, id };
+	unsigned position = _positions[id];
+	if (position == INVALID_POSITION) {
+		position = _heap.size();
+		_heap.push_back(entry);
+		_positions[id] = position;
+		sift_up(position);
+		return;
+	}
+
+	const double previous_deadline = _heap[position].deadline;
+	_heap[position].deadline = deadline;
+	if (deadline < previous_deadline)
+		sift_up(position);
+	else
+		sift_down(position);
+}
+
+void DeadlineQueue::remove(unsigned id)
+{
+	if (id >= _positions.size() || _positions[id] == INVALID_POSITION)
+		return;
+
+	const unsigned position = _positions[id];
+	_positions[id] = INVALID_POSITION;
+
+	// Move the last entry in the hole and restore the heap order around it.
+	const Entry last = _heap.back();
+	_heap.pop_back();
+	if (position == _heap.size())
+		return;
+
+	const bool earlier = last.deadline < _heap[position].deadline;
+	place(position, last);
+	if (earlier)
+		sift_up(position);
+	else
+		sift_down(position);
+}
+
+unsigned DeadlineQueue::pop()
+{
+	const unsigned id = _heap[0].id;
+	remove(id);
+	return id;
+}
+
+void DeadlineQueue::place(unsigned position, const Entry& entry)
+{
+	_heap[position] = entry;
+	_positions[entry.id] = position;
+}
+
+void DeadlineQueue::sift_up(unsigned position)
+{
+	const Entry entry = _heap[position];
+	while (position > 0) {
+		const unsigned parent = (position - 1) / 2;
+		if (_heap[parent].deadline <= entry.deadline)
+			break;
+		place(position, _heap[parent]);
+		position = parent;
+	}
+	place(position, entry);
+}
+
+void DeadlineQueue::sift_down(unsigned position)
+{
+	const Entry entry = _heap[position];
+	const unsigned count = _heap.size();
+	for (;;) {
+		unsigned child = position * 2 + 1;
+		if (child >= count)
+			break;
+		if (child + 1 < count && _heap[child + 1].deadline < _heap[child].deadline)
+			++child;
+		if (entry.deadline <= _heap[child].deadline)
+			break;
+		place(position, _heap[child]);
+		position = child;
+	}
+	place(position, entry);
+}
+
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <plugin_foundation/allocator.h>
+#include <plugin_foundation/array.h>
+
+namespace PLUGIN_NAMESPACE {
+
+/**
+ * Min-heap of ids ordered by deadline. Each id is scheduled at most once and
+ * can be rescheduled or removed in O(log n). Ids are expected to be small
+ * indices, such as array slots.
+ */
+class DeadlineQueue
+{
+public:
+	explicit DeadlineQueue(stingray_plugin_foundation::Allocator& allocator);
+
+	/**
+	 * Schedules an id at a deadline, replacing its previous deadline if any.
+	 */
+	void schedule(unsigned id, double deadline);
+
+	/**
+	 * Removes an id from the queue, if scheduled.
+	 */
+	void remove(unsigned id);
+
+	bool empty() const { return _heap.empty(); }
+	unsigned size() const { return _heap.size(); }
+
+	/**
+	 * Returns the earliest deadline.
+	 */
+	double top_deadline() const { return _heap[0].deadline; }
+
+	/**
+	 * Removes and returns the id with the earliest deadline.
+	 */
+	unsigned pop();
+
+private:
+	struct Entry
+	{
+		double deadline;
+		unsigned id;
+	};
+
+	void place(unsigned position, const Entry& entry);
+	void sift_up(unsigned position);
+	void sift_down(unsigned position);
+
+	stingray_plugin_foundation::Array<Entry> _heap;
+
+	// Heap position of each id, or INVALID_POSITION if not scheduled.
+	stingray_plugin_foundation::Array<unsigned> _positions;
+	static const unsigned INVALID_POSITION = 0xffffffffu;
+};
+
+}
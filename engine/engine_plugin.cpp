@@ -3,20 +3,47 @@
 #include <plugin_foundation/id_string.h>
 #include <plugin_foundation/string.h>
 #include <plugin_foundation/allocator.h>
+#include <plugin_foundation/hash_map.h>
+#include <plugin_foundation/flow.h>
+
+#include <math.h>
+#include <stddef.h>
+#include <algorithm>
+#include <initializer_list>
+#include <atomic>
+#include <thread>
 
 #if _DEBUG
 	#include <stdlib.h>
 	#include <time.h>
 #endif
 
+namespace PLUGIN_NAMESPACE {
+void* stbi_allocate(size_t size);
+void* stbi_reallocate(void* p, size_t old_size, size_t new_size);
+void stbi_deallocate(void* p);
+}
+
+// Decoded images are allocated by the plugin allocator, to be tracked by the engine.
+#define STBI_MALLOC(size) PLUGIN_NAMESPACE::stbi_allocate(size)
+#define STBI_REALLOC_SIZED(p, old_size, new_size) PLUGIN_NAMESPACE::stbi_reallocate(p, old_size, new_size)
+#define STBI_FREE(p) PLUGIN_NAMESPACE::stbi_deallocate(p)
+
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #define STBI_ONLY_PNG
-#define STBI_ONLY_GIF
 
 #include <stb_image.h>
 #include <stb_image_write.h>
 
+#include "gif_resource.h"
+#include "gif_decoder.h"
+#include "gif_encoder.h"
+#include "worker_pool.h"
+#include "view_culling.h"
+#include "deadline_queue.h"
+#include "upload_queue.h"
+
 namespace PLUGIN_NAMESPACE {
 
 using namespace stingray_plugin_foundation;
@@ -32,9 +59,18 @@ AllocatorObject *allocator_object = nullptr;
 ApiAllocator _allocator(nullptr, nullptr);
 LoggingApi *log = nullptr;
 ErrorApi *error = nullptr;
+LuaApi* lua = nullptr;
+FlowNodesApi* flow_nodes = nullptr;
 UnitApi* unit = nullptr;
+UnitReferenceApi* unit_reference = nullptr;
 ResourceManagerApi* resource_manager = nullptr;
 RenderBufferApi* render_buffer = nullptr;
+ThreadApi* thread = nullptr;
+FutureInputArchiveApi* future_input_archive = nullptr;
+InputArchiveApi* input_archive = nullptr;
+InputBufferApi* input_buffer = nullptr;
+ProfilerApi* profiler = nullptr;
+TimerApi* timer = nullptr;
 
 // C Scripting API
 namespace stingray {
@@ -44,26 +80,234 @@ namespace stingray {
 	struct DynamicScriptDataCApi* Data = nullptr;
 }
 
+/**
+* Engine profiler scope lasting until the end of the block it is declared in.
+*/
+struct ProfileScope
+{
+	explicit ProfileScope(const char* name) { profiler->profile_start(name); }
+	~ProfileScope() { profiler->profile_stop(); }
+};
+
+/**
+* Runtime counters printed by the giphy_stats console command, to size the
+* budgets of each platform. Totals and peaks add up until reset.
+*/
+struct GiphyCounters
+{
+	uint64_t decoded_bytes;
+	uint64_t frame_uploaded_bytes;
+	uint64_t peak_frame_uploaded_bytes;
+	unsigned cache_hits;
+	unsigned cache_misses;
+	double worst_spawn_latency;
+	double update_time;
+	double peak_update_time;
+};
+GiphyCounters counters;
+
+/**
+* Playable GIF frames, either mapped from a compiled resource or decoded at runtime.
+*/
+struct GifFrames
+{
+	unsigned width;
+	unsigned height;
+	unsigned frame_count;
+
+	// GifPixelFormat of the frame data.
+	unsigned format;
+
+	// Frames stored back to back, or the key frame and dirty rectangles
+	// pixels of delta encoded frames.
+	const unsigned char* data;
+
+	// Frame delays in 1/100 seconds.
+	const unsigned short* delays;
+
+	// R8G8B8A8 colors of indexed frames.
+	const unsigned* palette;
+
+	// Dirty rectangles to upload per frame, if frames are delta encoded.
+	const GifFrameDelta* deltas;
+	const GifDirtyRect* rects;
+
+	// Frames decoded at runtime that need to be released, if any.
+	unsigned char* decoded_data;
+
+	// True if the frame data is streamed in by each giphy while playing.
+	bool streamed;
+};
+
+/**
+* Runtime decoding of a source encoded GIF resource, executed by a decode worker.
+*/
+struct GifDecodeJob
+{
+	WorkerTask task;
+	const GifResourceHeader* resource;
+	GifFrames frames;
+};
+
+/**
+* Resource stream a giphy reads its frame data from while playing.
+*/
+struct GifFrameStream
+{
+	FutureInputArchive* future_archive;
+	InputArchive* archive;
+	InputBuffer* buffer;
+
+	// Size of the chunks read ahead of the playhead.
+	unsigned read_chunk_size;
+};
+
+struct GifCacheEntry;
+
+/**
+* In-memory representation of a GIF resource, loaded on the resource streaming
+* thread along with its frames, decoded there if source encoded.
+*/
+struct GifLoadedResource
+{
+	ResourceID name;
+
+	// Compiled resource data.
+	const GifResourceHeader* header;
+
+	// Frames of the resource. Frames decoded while loading are handed over to
+	// the shared frames created from them.
+	GifFrames frames;
+	bool valid;
+
+	// Shared frames registered when brought in, if any.
+	GifCacheEntry* gif;
+
+	// Links of the list of loaded resources.
+	GifLoadedResource* previous_loaded;
+	GifLoadedResource* next_loaded;
+};
+
+/**
+* GIF frames shared by all the units displaying the same resource.
+*/
+struct GifCacheEntry
+{
+	// Hashed resource name the frames belong to, and its data.
+	uint64_t resource_id;
+	const GifResourceHeader* resource;
+
+	// Loaded resource holding a reference to the frames, if any.
+	GifLoadedResource* loaded_resource;
+
+	// Number of giphies using the frames.
+	unsigned ref_count;
+
+	GifFrames frames;
+
+	// Pending runtime decoding of the frames, if any.
+	GifDecodeJob* decode_job;
+
+	// Texture array holding all the frames, one per slice, if any giphy
+	// plays the frames GPU resident.
+	unsigned texture_array_handle;
+	unsigned texture_array_size;
+
+	// Palette texture of indexed frames, if any giphy samples them through it.
+	unsigned palette_handle;
+
+	// True if the decoded frames were evicted, to be decoded again when needed.
+	bool evicted;
+
+	// Slot of the giphy playing the frames for units sharing their clock, if any.
+	unsigned shared_giphy;
+
+	// Last time a giphy used the frames data.
+	double last_used_time;
+};
+
+/**
+* Mesh and material displaying a giphy.
+*/
+struct GiphyTarget
+{
+	MeshPtr mesh;
+	MaterialPtr material;
+};
+
+// Maximum number of meshes and materials displaying the giphy of a unit.
+const unsigned MAX_GIPHY_TARGETS = 8;
+
 struct UnitGiphy
 {
 	// Used to reused released giphy slots
 	bool used;
 
+	// Next unused giphy slot, if unused.
+	unsigned next_free;
+
 	// Used to find an existing giphy data.
 	CApiUnit* unit_instance;
 
-	// Gif image data
-	unsigned width;
-	unsigned height;
-	unsigned char* gif_data;
+	// Gif image data, shared with other units using the same resource.
+	GifCacheEntry* gif;
+
+	// Stream of the frame data, if streamed.
+	GifFrameStream* stream;
 
-	// Texture data
+	// Texture data, invalid if the giphy plays from the shared texture array.
 	unsigned texture_buffer_handle;
 
+	// True if indexed frames are expanded to R8G8B8A8 when uploaded, because
+	// the material has no palette texture slot.
+	bool expand_palette;
+
+	// Meshes and materials displaying the giphy, all bound to its texture.
+	// Their meshes are used to throttle texture updates.
+	GiphyTarget targets[MAX_GIPHY_TARGETS];
+	unsigned target_count;
+
+	// Material variable to set to the current frame index, if the giphy
+	// plays from the shared texture array.
+	unsigned frame_index_variable;
+
+	// Slot of the giphy whose texture and playback this unit shares, if any.
+	// Such giphies have no unit and link the units sharing them from their
+	// next_shared_member, which links the next one in the units.
+	unsigned shared_slot;
+	unsigned next_shared_member;
+
 	// Playback data
+	bool playing;
 	unsigned frame_count;
 	unsigned current_frame;
-	float next_frame_delay;
+	double next_frame_time;
+
+	// Playback control. Paused giphies hold the current frame for the time
+	// it had left.
+	bool paused;
+	float speed;
+	double paused_frame_time_left;
+
+	// True if the unit gets a Flow event each time the giphy completes a loop.
+	bool loop_events;
+
+	// Frame shown by the texture, behind the current frame while throttled.
+	unsigned uploaded_frame;
+	double next_upload_time;
+
+	// Time the texture update was first queued, negative if none is.
+	double upload_queued_time;
+};
+
+/**
+* Texture update of a giphy waiting for upload budget.
+*/
+struct QueuedUpload
+{
+	unsigned slot;
+	float priority;
+	float interval;
 };
 
 /**
@@ -71,244 +315,1841 @@ struct UnitGiphy
 */
 Array<UnitGiphy>* giphies = nullptr;
 
-// Data compiler resource properties
-int RESOURCE_VERSION = 1;
-const char *RESOURCE_EXTENSION = "gif";
-const IdString64 RESOURCE_ID = IdString64(RESOURCE_EXTENSION);
-
 /**
- * Returns the plugin name.
- */
-const char* get_name() { return "giphy_plugin"; }
+* Slot of the giphy of each unit, and first unused slot to reuse.
+*/
+typedef HashMap<CApiUnit*, unsigned> GiphySlots;
+GiphySlots* giphy_slots = nullptr;
 
 /**
- * Clone the source resource data and append it's buffer size in front of the 
- * data result buffer.
- */
-DataCompileResult pack_source_data_with_size(DataCompileParameters *input, const DataCompileResult& result_data)
+* Mesh and material indices of the giphy targets of a unit type.
+*/
+struct GiphyTargetIndices
 {
-	DataCompileResult result = { nullptr };
-	unsigned length_with_data_size = result_data.data.len + sizeof(unsigned);
-	result.data.p = (char*)allocator_api->allocate(data_compile_params->allocator(input), length_with_data_size, 4);
-	result.data.len = length_with_data_size;
-	memcpy(result.data.p, &result_data.data.len, sizeof(unsigned));
-	memcpy(result.data.p + sizeof(unsigned), result_data.data.p, result_data.data.len);
-	return result;
-}
+	unsigned count;
+	unsigned mesh_index[MAX_GIPHY_TARGETS];
+	unsigned material_index[MAX_GIPHY_TARGETS];
+};
+
+// Giphy targets of the unit types spawned so far, by unit resource name.
+typedef HashMap<uint64_t, GiphyTargetIndices> GiphyTargetCache;
+GiphyTargetCache* giphy_target_cache = nullptr;
+unsigned first_free_giphy = INVALID_HANDLE;
 
 /**
- * Define plugin resource compiler.
- */
-DataCompileResult gif_compiler(DataCompileParameters *input)
-{
-	auto source_data = data_compile_params->read(input);
-	if (source_data.error)
-		return source_data;
-	return pack_source_data_with_size(input, source_data);
-}
+* Frames of all the GIF resources in use, by hashed resource name.
+*/
+typedef HashMap<uint64_t, GifCacheEntry*> GifCache;
+GifCache* gif_cache = nullptr;
 
 /**
-* Load all GIF animations from a memory buffer.
+* Workers decoding source encoded GIF resources off the game thread.
 */
-STBIDEF unsigned char *gif_load_frames(stbi_uc const *buffer, int len, int *x, int *y, int *frames)
-{
-	typedef struct gif_result_t {
-		int delay;
-		unsigned char *data;
-		struct gif_result_t *next;
-	} gif_result;
+WorkerPool* decode_workers = nullptr;
+unsigned DECODE_WORKER_COUNT = 2;
 
-	stbi__context s;
-	unsigned char *result;
+/**
+* Transparent pixels shown until the frames of a giphy are decoded.
+*/
+Array<unsigned char>* placeholder_pixels = nullptr;
 
-	stbi__start_mem(&s, buffer, len);
+/**
+* Indexed frame pixels expanded to R8G8B8A8 for upload.
+*/
+Array<unsigned char>* expanded_pixels = nullptr;
 
-	if (stbi__gif_test(&s)) {
-		int c;
-		stbi__gif g;
-		gif_result head;
-		gif_result *prev = nullptr, *gr = &head;
+/**
+* GPU memory all shared texture arrays can use. GIFs that do not fit
+* fall back to uploading each frame to a per giphy texture.
+*/
+uint64_t TEXTURE_ARRAY_MEMORY_BUDGET = 64 * 1024 * 1024;
+uint64_t texture_array_memory = 0;
 
-		memset(&g, 0, sizeof(g));
-		memset(&head, 0, sizeof(head));
+/**
+* Memory decoded frames can use. Once over it, the frames of the GIFs least
+* recently used by a giphy get evicted, and decoded again when needed.
+*/
+uint64_t DECODED_FRAMES_MEMORY_BUDGET = 128 * 1024 * 1024;
+uint64_t decoded_frames_memory = 0;
+Array<GifCacheEntry*>* eviction_candidates = nullptr;
 
-		*frames = 0;
+/**
+* Number of frames streamed giphies read ahead of their playhead.
+*/
+unsigned STREAM_READ_AHEAD_FRAMES = 8;
 
-		while ((gr->data = stbi__gif_load_next(&s, &g, &c, 4))) {
-			if (gr->data == (unsigned char*)&s) {
-				gr->data = nullptr;
-				break;
-			}
+/**
+* Camera view set from Lua. Giphies out of it do not update their texture,
+* and giphies further than THROTTLE_FULL_RATE_DISTANCE update it less often,
+* waiting THROTTLE_UPLOAD_INTERVAL_STEP more per such distance, up to
+* THROTTLE_MAX_UPLOAD_INTERVAL.
+*/
+GiphyView playback_view;
+bool playback_view_set = false;
+float THROTTLE_FULL_RATE_DISTANCE = 15.0f;
+float THROTTLE_UPLOAD_INTERVAL_STEP = 0.1f;
+float THROTTLE_MAX_UPLOAD_INTERVAL = 0.5f;
 
-			if (prev) prev->next = gr;
-			gr->delay = g.delay;
-			prev = gr;
-			gr = (gif_result*)stbi__malloc(sizeof(gif_result));
-			memset(gr, 0, sizeof(gif_result));
-			++(*frames);
-		}
+/**
+* Skipped frames rectangles to upload when a throttled giphy catches up.
+*/
+Array<const GifDirtyRect*>* catch_up_rects = nullptr;
+const unsigned MAX_CATCH_UP_COVERING_RECTS = 32;
 
-		STBI_FREE(g.out);
+/**
+* Plugin clock giphies are scheduled on, and the slots of the giphies keyed on
+* the time of their next frame or texture update. Giphies with frame delays
+* shorter than MIN_FRAME_DELAY play at that delay, and paused off-screen
+* giphies check if they are visible again every VISIBILITY_CHECK_INTERVAL.
+* Scripts cannot slow giphies down below MIN_PLAYBACK_SPEED.
+*/
+double playback_time = 0.0;
+DeadlineQueue* giphy_schedule = nullptr;
+Array<unsigned>* due_giphies = nullptr;
+const double MIN_FRAME_DELAY = 0.02;
+const double VISIBILITY_CHECK_INTERVAL = 0.1;
+const float MIN_PLAYBACK_SPEED = 0.01f;
 
-		if (gr != &head)
-			STBI_FREE(gr);
+// Flow unit event raised when a giphy completes a loop.
+const unsigned LOOP_COMPLETED_EVENT_ID = IdString32("giphy_loop_completed").id();
 
-		if (*frames > 0) {
-			*x = g.w;
-			*y = g.h;
-		}
+/**
+* Bytes of texture data uploaded per frame. All texture updates get queued
+* and uploaded by priority until the budget is spent, the first one always
+* getting through. The others are deferred to the next frame and gain
+* priority the later they get, doubling it every
+* UPLOAD_LATENESS_PRIORITY_STEP up to UPLOAD_LATENESS_MAX_DOUBLINGS times.
+* A budget of 0 uploads everything.
+*/
+uint64_t UPLOAD_BUDGET = 4 * 1024 * 1024;
+double UPLOAD_LATENESS_PRIORITY_STEP = 0.1;
+const int UPLOAD_LATENESS_MAX_DOUBLINGS = 16;
+Array<QueuedUpload>* queued_uploads = nullptr;
+uint64_t uploaded_bytes = 0;
+unsigned deferred_uploads = 0;
+double max_upload_lateness = 0.0;
+
+/**
+* Texture updates executed by the render thread when it begins a frame, and
+* the buffers and decoded frames released by giphies, destroyed once the
+* updates recorded up to their release were executed.
+*/
+struct RetiredUploadSource
+{
+	uint64_t fence;
+	unsigned buffer_handle;
+	unsigned char* decoded_data;
+};
+UploadQueue* texture_uploads = nullptr;
+Array<RetiredUploadSource>* retired_upload_sources = nullptr;
+
+/**
+* Texture updates queue handed over to the render thread, and whether the
+* render thread is using it. The game thread detaches the queue before
+* deleting it.
+*/
+std::atomic<UploadQueue*> render_thread_uploads(nullptr);
+std::atomic<bool> render_thread_executes_uploads(false);
 
-		result = head.data;
+// Thread recording the texture updates.
+std::thread::id game_thread_id;
 
-		if (*frames > 1) {
-			unsigned int size = 4 * g.w * g.h;
-			unsigned char *p;
+/**
+* Loader of GIF resources.
+*/
+RM_ResourceTypeCallbacks gif_resource_callbacks;
+
+/**
+* GIF resources loaded by the resource manager, which frames decoded while
+* loading must be freed before the plugin allocator gets destroyed.
+*/
+GifLoadedResource* loaded_resources = nullptr;
+ThreadCriticalSection* loaded_resources_lock = nullptr;
+
+// Data compiler resource properties. Frame data larger than the threshold is
+// streamed, up to the largest the 32-bit compiled resource sizes can hold.
+int RESOURCE_VERSION = GIF_RESOURCE_VERSION;
+uint64_t STREAM_FRAMES_SIZE_THRESHOLD = 16 * 1024 * 1024;
+uint64_t MAX_COMPILED_FRAMES_SIZE = 0xffffffffu & ~(uint64_t)(GIF_RESOURCE_DATA_ALIGN - 1);
+const char *RESOURCE_EXTENSION = "gif";
+const IdString64 RESOURCE_ID = IdString64(RESOURCE_EXTENSION);
 
-			result = (unsigned char*)stbi__malloc(*frames * (size + 2));
-			gr = &head;
-			p = result;
+/**
+ * Returns the plugin name.
+ */
+const char* get_name() { return "giphy_plugin"; }
 
-			while (gr) {
-				prev = gr;
-				memcpy(p, gr->data, size);
-				p += size;
-				*p++ = gr->delay & 0xFF;
-				*p++ = (gr->delay & 0xFF00) >> 8;
-				gr = gr->next;
+void* stbi_allocate(size_t size)
+{
+	return _allocator.allocate(size, 16);
+}
 
-				STBI_FREE(prev->data);
-				if (prev != &head) STBI_FREE(prev);
-			}
-		}
-	}
-	else {
-		stbi__result_info result_info;
-		result = (unsigned char*)stbi__load_main(&s, x, y, frames, 4, &result_info, 0);
-		*frames = !!result;
+void* stbi_reallocate(void* p, size_t old_size, size_t new_size)
+{
+	void* reallocated = _allocator.allocate(new_size, 16);
+	if (p) {
+		memcpy(reallocated, p, old_size < new_size ? old_size : new_size);
+		_allocator.deallocate(p);
 	}
+	return reallocated;
+}
 
-	return result;
+void stbi_deallocate(void* p)
+{
+	if (p)
+		_allocator.deallocate(p);
 }
 
 /**
- * Setup runtime and compiler common resources, such as allocators.
- */
-void setup_common_api(GetApiFunction get_engine_api)
+* Load all GIF animations from a memory buffer.
+* The frames get scanned first to decode them to a single allocation, holding
+* all RGBA frames back to back, with the frame delays (in 1/100 seconds) set
+* apart. Images other than GIFs are loaded by stb as a single frame.
+*/
+unsigned char* gif_load_frames(const unsigned char* buffer, int len, int* x, int* y, Array<unsigned short>& delays)
 {
-	allocator_api = (AllocatorApi*)get_engine_api(ALLOCATOR_API_ID);
-	if (allocator_object == nullptr) {
-		allocator_object = allocator_api->make_plugin_allocator(get_name());
-		_allocator = ApiAllocator(allocator_api, allocator_object);
+	unsigned width = 0, height = 0;
+	if (gif_scan_frames(buffer, (unsigned)len, &width, &height, delays)) {
+		auto frames = (unsigned char*)stbi_allocate((size_t)width * height * 4 * delays.size());
+		const auto frame_count = gif_decode_frames(_allocator, buffer, (unsigned)len, width, height, delays.size(), frames);
+		if (frame_count == 0) {
+			STBI_FREE(frames);
+			return nullptr;
+		}
+		delays.resize(frame_count);
+		*x = (int)width;
+		*y = (int)height;
+		return frames;
 	}
 
-	log = (LoggingApi*)get_engine_api(LOGGING_API_ID);
-	error = (ErrorApi*)get_engine_api(ERROR_API_ID);
-	resource_manager = (ResourceManagerApi*)get_engine_api(RESOURCE_MANAGER_API_ID);
+	int channels = 0;
+	auto image = stbi_load_from_memory(buffer, len, x, y, &channels, 4);
+	delays.resize(image ? 1 : 0);
+	if (image)
+		delays[0] = 0;
+	return image;
 }
 
 /**
- * Setup plugin runtime resources.
+ * Round up a value to the specified power of two alignment.
  */
-void setup_plugin(GetApiFunction get_engine_api)
+unsigned align_to(unsigned value, unsigned align)
 {
-	setup_common_api(get_engine_api);
-
-	unit = (UnitApi*)get_engine_api(UNIT_API_ID);
-	render_buffer = (RenderBufferApi*)get_engine_api(RENDER_BUFFER_API_ID);
-	auto c_api = (ScriptApi*)get_engine_api(C_API_ID);
-	stingray::Unit = c_api->Unit;
-	stingray::Mesh = c_api->Mesh;
-	stingray::Material = c_api->Material;
-	stingray::Data = c_api->DynamicScriptData;
-
-	giphies = MAKE_NEW(_allocator, Array<UnitGiphy>, _allocator);
+	return (value + align - 1) & ~(align - 1);
 }
 
 /**
- * Setup plugin compiler resources.
+ * Returns true if the platform GPUs can sample BC compressed textures.
  */
-void setup_data_compiler(GetApiFunction get_engine_api)
+bool platform_supports_block_compression(const char* platform)
 {
-	setup_common_api(get_engine_api);
-
-	#if _DEBUG
-		// Always trigger the resource compiler in debug mode.
-		srand(time(nullptr));
-		RESOURCE_VERSION = rand();
-	#endif
-
-	data_compiler = (DataCompilerApi*)get_engine_api(DATA_COMPILER_API_ID);
-	data_compile_params = (DataCompileParametersApi*)get_engine_api(DATA_COMPILE_PARAMETERS_API_ID);
-	data_compiler->add_compiler(RESOURCE_EXTENSION, RESOURCE_VERSION, gif_compiler);
+	return strcmp(platform, "android") != 0 && strcmp(platform, "ios") != 0 && strcmp(platform, "web") != 0;
 }
 
 /**
- * Indicate to the resource manager that we'll be using our plugin resource type.
+ * Finds the rectangles to upload when each frame gets displayed, including
+ * the first one when looping back from the last frame. Returns the size of
+ * the frames data in a format, only counted up to the compiled frames size
+ * cap, past which frames are no longer compared.
  */
-void setup_resources(GetApiFunction get_engine_api)
+uint64_t find_frame_deltas(const unsigned char* frames_data, unsigned width, unsigned height, unsigned frames, unsigned format, Array<GifFrameDelta>& deltas, Array<GifDirtyRect>& rects)
 {
-	setup_common_api(get_engine_api);
-	resource_manager->register_type(RESOURCE_EXTENSION);
+	const unsigned frame_size = width * height * 4;
+	const unsigned block_size = gif_format_block_size(format);
+	uint64_t delta_data_size = align_to(gif_image_size(width, height, format), GIF_RESOURCE_DATA_ALIGN);
+	rects.resize(0);
+	for (unsigned f = 0; f < frames; ++f) {
+		deltas[f].first_rect = rects.size();
+		deltas[f].rect_count = 0;
+		if (frames < 2 || delta_data_size > MAX_COMPILED_FRAMES_SIZE)
+			continue;
+
+		auto prev_frame = frames_data + (uint64_t)((f + frames - 1) % frames) * frame_size;
+		auto frame = frames_data + (uint64_t)f * frame_size;
+		deltas[f].rect_count = find_dirty_rects(prev_frame, frame, width, height, block_size, rects);
+		for (unsigned r = deltas[f].first_rect; r < rects.size(); ++r)
+			delta_data_size += align_to(gif_image_size(rects[r].width, rects[r].height, format), GIF_RESOURCE_DATA_ALIGN);
+	}
+	return delta_data_size;
 }
 
 /**
- * Called per game frame.
- * Each frame, playback the GIF animation.
+ * Define plugin resource compiler.
+ * GIF frames are decoded and composited at compile time, then delta encoded
+ * so the runtime only has to map the resource data and upload the pixels
+ * that change from one frame to the next. Frames are block compressed on
+ * platforms supporting it, when their dimensions are a multiple of the
+ * block size. Large frame data is stored in the resource stream, only GIFs
+ * which frame data would not fit in it keep their source bytes and get
+ * decoded at runtime.
  */
-void update_plugin(float dt)
+DataCompileResult gif_compiler(DataCompileParameters *input)
 {
-	for (unsigned g = 0; g < giphies->size(); ++g) {
-		auto& ug = (*giphies)[g];
+	auto source_data = data_compile_params->read(input);
+	if (source_data.error)
+		return source_data;
 
-		// Skip unit that do not have a Giphy
-		if (!ug.used)
-			continue;
+	DataCompileResult result = { nullptr };
+
+	int width = 0, height = 0;
+	Array<unsigned short> frame_delays(_allocator);
+	auto frames_data = gif_load_frames((const unsigned char*)source_data.data.p, source_data.data.len, &width, &height, frame_delays);
+	if (frames_data == nullptr) {
+		result.error = error->eprintf("Cannot parse GIF `%s`", data_compile_params->source_path(input));
+		return result;
+	}
+
+	const int frames = (int)frame_delays.size();
+	const auto delays = frame_delays.begin();
+
+	// Use BC1 for opaque GIFs, then palette indices for GIFs with at most 256
+	// colors, and BC3 for the others.
+	const uint64_t pixel_count = (uint64_t)width * height * frames;
+	const bool block_compression = platform_supports_block_compression(data_compile_params->destination_platform(input)) && width % 4 == 0 && height % 4 == 0;
+	auto format = GIF_FORMAT_R8G8B8A8;
+	unsigned palette[GIF_PALETTE_SIZE];
+	Array<unsigned char> indexed_frames(_allocator);
+	Array<GifFrameDelta> deltas(frames, _allocator);
+	Array<GifDirtyRect> rects(_allocator);
+	uint64_t delta_data_size = 0;
+	if (block_compression && !has_transparent_pixels(frames_data, pixel_count)) {
+		format = GIF_FORMAT_BC1;
+	} else {
+		// Indices of frames whose delta data exceeds the cap would not be
+		// stored, keeping their source bytes, so skip the palette pass then.
+		const uint64_t indexed_frames_size = (uint64_t)gif_image_size(width, height, GIF_FORMAT_INDEXED8) * frames;
+		if (indexed_frames_size <= MAX_COMPILED_FRAMES_SIZE) {
+			delta_data_size = find_frame_deltas(frames_data, width, height, frames, GIF_FORMAT_INDEXED8, deltas, rects);
+			if (delta_data_size <= MAX_COMPILED_FRAMES_SIZE) {
+				indexed_frames.resize((unsigned)indexed_frames_size);
+				if (build_palette(frames_data, pixel_count, palette, indexed_frames.begin()) > 0)
+					format = GIF_FORMAT_INDEXED8;
+			}
+		}
+		if (format != GIF_FORMAT_INDEXED8 && block_compression)
+			format = GIF_FORMAT_BC3;
+	}
+	if (format != GIF_FORMAT_INDEXED8)
+		delta_data_size = find_frame_deltas(frames_data, width, height, frames, format, deltas, rects);
+	const unsigned key_frame_data_size = align_to(gif_image_size(width, height, format), GIF_RESOURCE_DATA_ALIGN);
+
+	auto encoding = GIF_ENCODING_SOURCE;
+	if (delta_data_size <= STREAM_FRAMES_SIZE_THRESHOLD)
+		encoding = GIF_ENCODING_DELTA;
+	else if (delta_data_size <= MAX_COMPILED_FRAMES_SIZE)
+		encoding = GIF_ENCODING_STREAM;
+
+	// Lay out the rectangles pixels in playback order from the second frame, the
+	// first frame ones only being needed when looping back.
+	if (encoding != GIF_ENCODING_SOURCE) {
+		unsigned data_offset = key_frame_data_size;
+		for (int i = 1; i <= frames; ++i) {
+			const auto& delta = deltas[i % frames];
+			for (unsigned r = delta.first_rect; r < delta.first_rect + delta.rect_count; ++r) {
+				rects[r].data_offset = data_offset;
+				data_offset += align_to(gif_image_size(rects[r].width, rects[r].height, format), GIF_RESOURCE_DATA_ALIGN);
+			}
+		}
+	}
 
-		// Update frame delay
-		ug.next_frame_delay -= dt;
+	GifResourceHeader header;
+	memset(&header, 0, sizeof(header));
+	header.version = GIF_RESOURCE_VERSION;
+	header.encoding = encoding;
+	header.format = encoding != GIF_ENCODING_SOURCE ? format : GIF_FORMAT_R8G8B8A8;
+	header.width = width;
+	header.height = height;
+	header.frame_count = frames;
+
+	unsigned offset = sizeof(GifResourceHeader);
+	header.delays_offset = offset;
+	offset += frames * sizeof(unsigned short);
+	if (encoding != GIF_ENCODING_SOURCE) {
+		offset = align_to(offset, 4);
+		header.deltas_offset = offset;
+		offset += frames * sizeof(GifFrameDelta);
+		header.rects_offset = offset;
+		header.rect_count = rects.size();
+		offset += rects.size() * sizeof(GifDirtyRect);
+		if (format == GIF_FORMAT_INDEXED8) {
+			header.palette_offset = offset;
+			offset += sizeof(palette);
+		}
+	}
+	header.data_offset = encoding != GIF_ENCODING_STREAM ? align_to(offset, GIF_RESOURCE_DATA_ALIGN) : 0;
+	header.data_size = encoding != GIF_ENCODING_SOURCE ? (unsigned)delta_data_size : source_data.data.len;
+
+	auto compile_allocator = data_compile_params->allocator(input);
+	result.data.len = encoding != GIF_ENCODING_STREAM ? header.data_offset + header.data_size : offset;
+	result.data.p = (char*)allocator_api->allocate(compile_allocator, result.data.len, GIF_RESOURCE_DATA_ALIGN);
+	memset(result.data.p, 0, result.data.len);
+	memcpy(result.data.p, &header, sizeof(header));
+	memcpy(result.data.p + header.delays_offset, delays, frames * sizeof(unsigned short));
+
+	auto data = (unsigned char*)result.data.p + header.data_offset;
+	if (encoding == GIF_ENCODING_STREAM) {
+		result.stream.len = header.data_size;
+		result.stream.p = (char*)allocator_api->allocate(compile_allocator, result.stream.len, GIF_RESOURCE_DATA_ALIGN);
+		memset(result.stream.p, 0, result.stream.len);
+		data = (unsigned char*)result.stream.p;
+	}
 
-		// Play next frame if the delay was reached.
-		if (ug.next_frame_delay <= 0.0f) {
-			ug.current_frame = (ug.current_frame + 1) % ug.frame_count;
-			const auto frame_size = ug.width * ug.height * 4;
-			auto next_frame_data = ug.gif_data + ug.current_frame * (frame_size + 2); // + 2 for delay info
-			render_buffer->update_buffer(ug.texture_buffer_handle, frame_size, next_frame_data);
+	if (encoding != GIF_ENCODING_SOURCE) {
+		memcpy(result.data.p + header.deltas_offset, deltas.begin(), frames * sizeof(GifFrameDelta));
+		memcpy(result.data.p + header.rects_offset, rects.begin(), rects.size() * sizeof(GifDirtyRect));
+
+		// Indexed frames get packed from their indices.
+		const unsigned char* pack_frames = frames_data;
+		uint64_t pack_frame_size = (uint64_t)width * height * 4;
+		if (format == GIF_FORMAT_INDEXED8) {
+			memcpy(result.data.p + header.palette_offset, palette, sizeof(palette));
+			pack_frames = indexed_frames.begin();
+			pack_frame_size = width * height;
+		}
 
-			auto delay = (stbi__uint16)*(next_frame_data + frame_size);
-			ug.next_frame_delay = delay / 100.0f;
+		// Store the first frame whole, then only the pixels of each dirty rectangle.
+		GifDirtyRect frame_rect = { 0, 0, (unsigned short)width, (unsigned short)height, 0 };
+		pack_rect_pixels(pack_frames, width, frame_rect, format, data);
+		for (int f = 0; f < frames; ++f) {
+			for (unsigned r = 0; r < deltas[f].rect_count; ++r) {
+				const auto& rect = rects[deltas[f].first_rect + r];
+				pack_rect_pixels(pack_frames + f * pack_frame_size, width, rect, format, data + rect.data_offset);
+			}
 		}
+	} else {
+		memcpy(data, source_data.data.p, header.data_size);
 	}
+
+	STBI_FREE(frames_data);
+	return result;
 }
 
 /**
-* Release giphy data and mark slot as unused.
-*/
-void release_giphy(UnitGiphy& giphy)
+ * Map the frames of a compiled GIF resource. The frame data of source encoded
+ * resources is left empty until decode_gif_frames() gets called, and the one
+ * of streamed resources is left for giphies to stream in.
+ */
+bool map_gif_frames(const GifResourceHeader* resource, GifFrames& frames)
 {
-	// Mark this slot as unused, so reusable.
-	giphy.used = false;
-
-	// Dispose of GIF animation image data.
-	STBI_FREE(giphy.gif_data);
-
-	// Release the texture buffer resource.
-	render_buffer->destroy_buffer(giphy.texture_buffer_handle);
-	giphy.texture_buffer_handle = INVALID_HANDLE;
+	memset(&frames, 0, sizeof(frames));
+	if (resource->version != GIF_RESOURCE_VERSION || resource->frame_count == 0)
+		return false;
+
+	frames.width = resource->width;
+	frames.height = resource->height;
+	frames.frame_count = resource->frame_count;
+	frames.format = resource->format;
+	frames.delays = gif_resource_delays(resource);
+
+	if (resource->encoding != GIF_ENCODING_SOURCE) {
+		frames.data = resource->encoding == GIF_ENCODING_DELTA ? gif_resource_data(resource) : nullptr;
+		frames.streamed = resource->encoding == GIF_ENCODING_STREAM;
+		frames.deltas = gif_resource_deltas(resource);
+		frames.rects = gif_resource_rects(resource);
+		if (resource->format == GIF_FORMAT_INDEXED8)
+			frames.palette = gif_resource_palette(resource);
+	}
+	return true;
 }
 
 /**
- * Release plugin resources.
+ * Decode the frames of a source encoded GIF resource. The decoded frames must
+ * be released with STBI_FREE(frames.decoded_data).
  */
-void shutdown_plugin()
+bool decode_gif_frames(const GifResourceHeader* resource, GifFrames& frames)
 {
-	if (giphies) {
-		for (unsigned i = 0; i < giphies->size(); ++i) {
-			auto& ug = (*giphies)[i];
-			if (!ug.used)
-				continue;
-			release_giphy(ug);
-		}
-		MAKE_DELETE(_allocator, giphies);
+	if (!map_gif_frames(resource, frames))
+		return false;
+
+	ProfileScope scope("giphy_decode");
+
+	// The resource already tells the frame count, so the frames get decoded
+	// straight to their final allocation.
+	const uint64_t frames_size = (uint64_t)frames.width * frames.height * 4 * frames.frame_count;
+	frames.decoded_data = (unsigned char*)stbi_allocate((size_t)frames_size);
+	const auto decoded_count = gif_decode_frames(_allocator, gif_resource_data(resource), resource->data_size,
+		frames.width, frames.height, frames.frame_count, frames.decoded_data);
+	if (decoded_count != frames.frame_count) {
+		STBI_FREE(frames.decoded_data);
+		frames.decoded_data = nullptr;
+		return false;
+	}
+	frames.data = frames.decoded_data;
+	return true;
+}
+
+/**
+ * Decode worker task entry point.
+ */
+void execute_decode_job(WorkerTask* task)
+{
+	auto job = (GifDecodeJob*)task;
+	decode_gif_frames(job->resource, job->frames);
+}
+
+/**
+ * Free a decode job along with any frames it decoded.
+ */
+void delete_decode_job(WorkerTask* task)
+{
+	auto job = (GifDecodeJob*)task;
+	STBI_FREE(job->frames.decoded_data);
+	MAKE_DELETE(_allocator, job);
+}
+
+/**
+ * Queue the runtime decoding of a source encoded GIF resource.
+ */
+GifDecodeJob* queue_decode_job(const GifResourceHeader* resource)
+{
+	if (decode_workers == nullptr)
+		decode_workers = MAKE_NEW(_allocator, WorkerPool, thread, profiler, _allocator, "giphy_decode", DECODE_WORKER_COUNT);
+
+	auto job = MAKE_NEW(_allocator, GifDecodeJob);
+	memset(job, 0, sizeof(GifDecodeJob));
+	job->task.execute = execute_decode_job;
+	job->task.release = delete_decode_job;
+	job->resource = resource;
+	decode_workers->queue(&job->task);
+	return job;
+}
+
+/**
+ * Cancel a decode job and free it along with any decoded frames. A running
+ * job cannot be interrupted and gets freed by its worker once done instead,
+ * without blocking the game thread. It keeps reading the data of its
+ * resource until then, so only destroying the resource waits for it.
+ */
+void release_decode_job(GifDecodeJob* job)
+{
+	decode_workers->orphan(&job->task);
+}
+
+/**
+ * Destroy a texture buffer and free decoded frames once the texture updates
+ * recorded so far were executed.
+ */
+void retire_upload_source(unsigned buffer_handle, unsigned char* decoded_data)
+{
+	RetiredUploadSource source;
+	source.fence = texture_uploads->fence();
+	source.buffer_handle = buffer_handle;
+	source.decoded_data = decoded_data;
+	retired_upload_sources->push_back(source);
+}
+
+/**
+ * Destroy the retired texture buffers and decoded frames no texture update
+ * uses anymore, or all of them.
+ */
+void release_retired_upload_sources(bool all)
+{
+	unsigned kept = 0;
+	for (unsigned i = 0; i < retired_upload_sources->size(); ++i) {
+		const auto& source = (*retired_upload_sources)[i];
+		if (!all && !texture_uploads->fence_passed(source.fence)) {
+			(*retired_upload_sources)[kept++] = source;
+			continue;
+		}
+		if (source.buffer_handle != INVALID_HANDLE)
+			render_buffer->destroy_buffer(source.buffer_handle);
+		STBI_FREE(source.decoded_data);
+	}
+	retired_upload_sources->resize(kept);
+}
+
+/**
+ * Returns the size of the frames decoded from a source encoded GIF resource.
+ */
+uint64_t decoded_frames_size(const GifFrames& frames)
+{
+	return (uint64_t)frames.frame_count * frames.width * frames.height * 4;
+}
+
+/**
+ * Get the frames of a GIF resource shared by all the units displaying it. The
+ * frames are mapped, or their decoding queued, the first time the resource is used.
+ */
+GifCacheEntry* acquire_gif(uint64_t resource_id, GifLoadedResource* resource)
+{
+	auto it = gif_cache->find(resource_id);
+	if (it != gif_cache->end()) {
+		++it->second->ref_count;
+		it->second->last_used_time = playback_time;
+		++counters.cache_hits;
+		return it->second;
+	}
+
+	++counters.cache_misses;
+	if (!resource->valid)
+		return nullptr;
+
+	// Take the frames decoded while loading over, once released or evicted
+	// they get decoded again at runtime.
+	auto frames = resource->frames;
+	if (frames.decoded_data) {
+		resource->frames.data = nullptr;
+		resource->frames.decoded_data = nullptr;
+		decoded_frames_memory += decoded_frames_size(frames);
+		counters.decoded_bytes += decoded_frames_size(frames);
+	}
+
+	auto gif = MAKE_NEW(_allocator, GifCacheEntry);
+	gif->resource_id = resource_id;
+	gif->resource = resource->header;
+	gif->loaded_resource = nullptr;
+	gif->ref_count = 1;
+	gif->frames = frames;
+	gif->decode_job = frames.data == nullptr && !frames.streamed ? queue_decode_job(resource->header) : nullptr;
+	gif->texture_array_handle = INVALID_HANDLE;
+	gif->texture_array_size = 0;
+	gif->palette_handle = INVALID_HANDLE;
+	gif->evicted = false;
+	gif->shared_giphy = INVALID_HANDLE;
+	gif->last_used_time = playback_time;
+	gif_cache->insert(resource_id, gif);
+	return gif;
+}
+
+/**
+ * Release a reference to shared GIF frames, the last one disposes of them.
+ */
+void release_gif(GifCacheEntry* gif)
+{
+	if (--gif->ref_count > 0)
+		return;
+
+	if (gif->decode_job)
+		release_decode_job(gif->decode_job);
+	if (gif->texture_array_handle != INVALID_HANDLE) {
+		render_buffer->destroy_buffer(gif->texture_array_handle);
+		texture_array_memory -= gif->texture_array_size;
+	}
+	if (gif->palette_handle != INVALID_HANDLE)
+		render_buffer->destroy_buffer(gif->palette_handle);
+	if (gif->frames.decoded_data) {
+		decoded_frames_memory -= decoded_frames_size(gif->frames);
+		retire_upload_source(INVALID_HANDLE, gif->frames.decoded_data);
+	}
+
+	// Frames of a reloaded resource are no longer cached.
+	auto it = gif_cache->find(gif->resource_id);
+	if (it != gif_cache->end() && it->second == gif)
+		gif_cache->erase(gif->resource_id);
+	MAKE_DELETE(_allocator, gif);
+}
+
+/**
+ * Load a GIF resource on the resource streaming thread, decoding its frames
+ * if source encoded so spawning units only has to look them up.
+ */
+void* load_gif_resource(void* obj, ResourceID name, InputArchive* archive, AllocatorObject* allocator, RenderResourceContext* rrc)
+{
+	const auto size = (unsigned)input_archive->size(archive);
+	auto resource = (GifLoadedResource*)allocator_api->allocate(allocator, sizeof(GifLoadedResource) + size, 16);
+	memset(resource, 0, sizeof(GifLoadedResource));
+	resource->name = name;
+	resource->header = (const GifResourceHeader*)(resource + 1);
+	input_archive->read(archive, resource + 1, size);
+
+	resource->valid = map_gif_frames(resource->header, resource->frames);
+	if (resource->valid && resource->header->encoding == GIF_ENCODING_SOURCE && !decode_gif_frames(resource->header, resource->frames)) {
+		log->warning(RESOURCE_EXTENSION, error->eprintf("Cannot decode giphy resource #ID[%016llx] data", name));
+		resource->valid = false;
+	}
+
+	thread->enter_critical_section(loaded_resources_lock);
+	resource->next_loaded = loaded_resources;
+	if (loaded_resources)
+		loaded_resources->previous_loaded = resource;
+	loaded_resources = resource;
+	thread->leave_critical_section(loaded_resources_lock);
+	return resource;
+}
+
+/**
+ * Detach the texture updates from the render thread, waiting for it to be
+ * done executing them if it got them already. It never waits for the game
+ * thread meanwhile, so no timeout is needed. The updates left then get
+ * executed by the game thread.
+ */
+void drain_texture_uploads()
+{
+	render_thread_uploads.store(nullptr);
+	while (render_thread_executes_uploads.load())
+		std::this_thread::yield();
+	texture_uploads->drain();
+}
+
+/**
+ * Waits for the texture updates recorded so far to be executed. The game
+ * thread executes them itself, as the render thread only executes updates
+ * when the game thread gets to the next frame. Other threads wait for it.
+ */
+void wait_for_recorded_uploads()
+{
+	if (texture_uploads == nullptr)
+		return;
+
+	if (std::this_thread::get_id() == game_thread_id) {
+		drain_texture_uploads();
+		render_thread_uploads.store(texture_uploads);
+		return;
+	}
+
+	const auto fence = texture_uploads->fence();
+	while (!texture_uploads->fence_passed(fence))
+		std::this_thread::yield();
+}
+
+/**
+ * Destroy a loaded GIF resource, along with the frames decoded while loading
+ * if no shared frames took them over.
+ */
+void destroy_gif_resource(void* obj, void* resource, AllocatorObject* allocator, RenderResourceContext* rrc)
+{
+	auto loaded = (GifLoadedResource*)resource;
+
+	// Released decode jobs may still be reading the resource data, and texture
+	// updates of mapped frames reference it until executed, whether recorded
+	// before the resource got brought out or by giphies not refreshed yet.
+	if (decode_workers)
+		decode_workers->wait_for_orphans();
+	wait_for_recorded_uploads();
+
+	// Resources still loaded when the plugin shut down are no longer listed.
+	if (loaded_resources_lock) {
+		thread->enter_critical_section(loaded_resources_lock);
+		if (loaded->previous_loaded)
+			loaded->previous_loaded->next_loaded = loaded->next_loaded;
+		else if (loaded_resources == loaded)
+			loaded_resources = loaded->next_loaded;
+		if (loaded->next_loaded)
+			loaded->next_loaded->previous_loaded = loaded->previous_loaded;
+		thread->leave_critical_section(loaded_resources_lock);
+	}
+
+	STBI_FREE(loaded->frames.decoded_data);
+	allocator_api->deallocate(allocator, loaded);
+}
+
+/**
+ * Register the frames of a loaded GIF resource as shared frames, held until
+ * the resource is brought out. The frames of a reloaded resource replace the
+ * previous ones, kept by their giphies until refreshed.
+ */
+void bring_in_gif_resource(void* obj, void* resource)
+{
+	auto loaded = (GifLoadedResource*)resource;
+	if (gif_cache == nullptr)
+		return;
+
+	gif_cache->erase(loaded->name);
+	loaded->gif = acquire_gif(loaded->name, loaded);
+	if (loaded->gif)
+		loaded->gif->loaded_resource = loaded;
+}
+
+/**
+ * Release the shared frames of a GIF resource about to be unloaded.
+ */
+void bring_out_gif_resource(void* obj, void* resource)
+{
+	auto loaded = (GifLoadedResource*)resource;
+	if (loaded->gif == nullptr)
+		return;
+
+	loaded->gif->loaded_resource = nullptr;
+	release_gif(loaded->gif);
+	loaded->gif = nullptr;
+}
+
+/**
+ * Swap in the decoded frames of a shared GIF once its decode job is done.
+ */
+void finish_decode_job(GifCacheEntry& gif)
+{
+	auto job = gif.decode_job;
+	gif.decode_job = nullptr;
+
+	gif.evicted = false;
+	if (job->frames.decoded_data == nullptr) {
+		log->warning(RESOURCE_EXTENSION, error->eprintf("Cannot decode giphy resource #ID[%016llx] data", gif.resource_id));
+	} else {
+		gif.frames = job->frames;
+		job->frames.decoded_data = nullptr;
+		decoded_frames_memory += decoded_frames_size(gif.frames);
+		counters.decoded_bytes += decoded_frames_size(gif.frames);
+	}
+
+	release_decode_job(job);
+}
+
+/**
+ * Returns the render buffer format of a GifPixelFormat.
+ */
+uint32_t texture_format(unsigned format)
+{
+	if (format == GIF_FORMAT_BC1)
+		return render_buffer->compressed_format(RB_BLOCK_COMPRESSED_1);
+	if (format == GIF_FORMAT_BC3)
+		return render_buffer->compressed_format(RB_BLOCK_COMPRESSED_3);
+	if (format == GIF_FORMAT_INDEXED8)
+		return render_buffer->format(RB_INTEGER_COMPONENT, false, true, 8, 0, 0, 0); // ImageFormat::PF_R8;
+	return render_buffer->format(RB_INTEGER_COMPONENT, false, true, 8, 8, 8, 8); // ImageFormat::PF_R8G8B8A8;
+}
+
+/**
+ * Create the 256x1 texture the material samples the colors of indexed frames from.
+ */
+void create_palette_texture(GifCacheEntry& gif)
+{
+	if (gif.palette_handle != INVALID_HANDLE)
+		return;
+
+	RB_TextureBufferView texture_buffer_view;
+	memset(&texture_buffer_view, 0, sizeof(texture_buffer_view));
+	texture_buffer_view.width = GIF_PALETTE_SIZE;
+	texture_buffer_view.height = 1;
+	texture_buffer_view.depth = 1;
+	texture_buffer_view.mip_levels = 1;
+	texture_buffer_view.slices = 1;
+	texture_buffer_view.type = RB_TEXTURE_TYPE_2D;
+	texture_buffer_view.format = texture_format(GIF_FORMAT_R8G8B8A8);
+	gif.palette_handle = render_buffer->create_buffer(GIF_PALETTE_SIZE * 4, RB_VALIDITY_STATIC, RB_TEXTURE_BUFFER_VIEW, &texture_buffer_view, gif.frames.palette);
+}
+
+/**
+ * Expand indexed frame pixels to R8G8B8A8 in a scratch buffer valid until the next call.
+ */
+const unsigned char* expand_pixels(const GifFrames& frames, const unsigned char* indices, unsigned pixel_count)
+{
+	if (expanded_pixels->size() < pixel_count * 4)
+		expanded_pixels->resize(pixel_count * 4);
+	expand_indexed_pixels(indices, pixel_count, frames.palette, expanded_pixels->begin());
+	return expanded_pixels->begin();
+}
+
+/**
+ * Create the texture array holding all the frames of a shared GIF, so giphies
+ * only have to select the slice to sample. Returns false if the frames are not
+ * available yet or do not fit in the texture array memory budget.
+ */
+bool create_texture_array(GifCacheEntry& gif)
+{
+	if (gif.texture_array_handle != INVALID_HANDLE)
+		return true;
+
+	const auto& frames = gif.frames;
+	if (frames.data == nullptr)
+		return false;
+
+	const uint64_t frame_size = gif_image_size(frames.width, frames.height, frames.format);
+	const uint64_t size = frame_size * frames.frame_count;
+	if (texture_array_memory + size > TEXTURE_ARRAY_MEMORY_BUDGET)
+		return false;
+
+	// Rebuild the whole frames of delta encoded GIFs from the key frame.
+	Array<unsigned char> slices(_allocator);
+	const unsigned char* slice_data = frames.data;
+	if (frames.deltas) {
+		slices.resize((unsigned)size);
+		memcpy(slices.begin(), frames.data, frame_size);
+		for (unsigned f = 1; f < frames.frame_count; ++f) {
+			auto slice = slices.begin() + f * frame_size;
+			memcpy(slice, slice - frame_size, frame_size);
+			const auto& delta = frames.deltas[f];
+			for (unsigned r = 0; r < delta.rect_count; ++r) {
+				const auto& rect = frames.rects[delta.first_rect + r];
+				unpack_rect_pixels(frames.data + rect.data_offset, frames.width, rect, frames.format, slice);
+			}
+		}
+		slice_data = slices.begin();
+	}
+
+	RB_TextureBufferView texture_buffer_view;
+	memset(&texture_buffer_view, 0, sizeof(texture_buffer_view));
+	texture_buffer_view.width = frames.width;
+	texture_buffer_view.height = frames.height;
+	texture_buffer_view.depth = 1;
+	texture_buffer_view.mip_levels = 1;
+	texture_buffer_view.slices = frames.frame_count;
+	texture_buffer_view.type = RB_TEXTURE_TYPE_2D;
+	texture_buffer_view.format = texture_format(frames.format);
+
+	gif.texture_array_size = (unsigned)size;
+	gif.texture_array_handle = render_buffer->create_buffer(gif.texture_array_size, RB_VALIDITY_STATIC, RB_TEXTURE_BUFFER_VIEW, &texture_buffer_view, slice_data);
+	texture_array_memory += size;
+	return true;
+}
+
+/**
+ * Setup runtime and compiler common resources, such as allocators.
+ */
+void setup_common_api(GetApiFunction get_engine_api)
+{
+	allocator_api = (AllocatorApi*)get_engine_api(ALLOCATOR_API_ID);
+	if (allocator_object == nullptr) {
+		allocator_object = allocator_api->make_plugin_allocator(get_name());
+		_allocator = ApiAllocator(allocator_api, allocator_object);
+	}
+
+	log = (LoggingApi*)get_engine_api(LOGGING_API_ID);
+	error = (ErrorApi*)get_engine_api(ERROR_API_ID);
+	resource_manager = (ResourceManagerApi*)get_engine_api(RESOURCE_MANAGER_API_ID);
+	profiler = (ProfilerApi*)get_engine_api(PROFILER_API_ID);
+	timer = (TimerApi*)get_engine_api(TIMER_API_ID);
+}
+
+/**
+ * stingray.Giphy.set_camera(pose, vertical_fov, aspect_ratio)
+ * Sets the camera view giphies are culled and throttled against.
+ */
+int lua_set_camera(lua_State* L)
+{
+	auto pose = lua->getmatrix4x4(L, 1);
+	auto vertical_fov = (float)lua->tonumber(L, 2);
+	auto aspect_ratio = (float)lua->tonumber(L, 3);
+	make_giphy_view(pose, vertical_fov, aspect_ratio, playback_view);
+	playback_view_set = true;
+	return 0;
+}
+
+/**
+ * stingray.Giphy.clear_camera()
+ * Updates all giphies at full rate again.
+ */
+int lua_clear_camera(lua_State*)
+{
+	playback_view_set = false;
+	return 0;
+}
+
+/**
+ * Sets the bytes of texture data uploaded per frame, 0 to upload everything.
+ */
+int lua_set_upload_budget(lua_State* L)
+{
+	const auto budget = lua->tonumber(L, 1);
+	UPLOAD_BUDGET = budget > 0.0 ? (uint64_t)budget : 0;
+	return 0;
+}
+
+/**
+ * Returns the number of texture updates deferred last frame, the bytes
+ * uploaded and how late, in seconds, the latest queued update was.
+ */
+int lua_upload_stats(lua_State* L)
+{
+	lua->pushinteger(L, deferred_uploads);
+	lua->pushnumber(L, (lua_Number)uploaded_bytes);
+	lua->pushnumber(L, max_upload_lateness);
+	return 3;
+}
+
+// Registers the playback control functions of the Giphy Lua module and
+// Flow nodes.
+void add_playback_module_functions();
+void setup_playback_flow_nodes();
+void unregister_playback_flow_nodes();
+
+/**
+ * giphy_stats [reset]
+ * Prints the giphy runtime counters, or resets their totals and peaks.
+ */
+int lua_giphy_stats(lua_State* L)
+{
+	if (lua->isstring(L, 1) && strcmp(lua->tolstring(L, 1, nullptr), "reset") == 0) {
+		memset(&counters, 0, sizeof(counters));
+		return 0;
+	}
+
+	// Giphies sharing the playback of another one are counted once.
+	unsigned playing = 0, paused = 0;
+	for (unsigned i = 0; i < giphies->size(); ++i) {
+		const auto& ug = (*giphies)[i];
+		if (!ug.used || ug.shared_slot != INVALID_HANDLE)
+			continue;
+		if (ug.paused)
+			++paused;
+		else
+			++playing;
+	}
+
+	const unsigned lookups = counters.cache_hits + counters.cache_misses;
+	const double hit_rate = lookups > 0 ? 100.0 * counters.cache_hits / lookups : 0.0;
+	log->info(get_name(), error->eprintf("giphies: %u units, %u playing, %u paused, %u scheduled",
+		giphy_slots->size(), playing, paused, giphy_schedule->size()));
+	log->info(get_name(), error->eprintf("decoded frames: %llu bytes total, %llu bytes resident",
+		counters.decoded_bytes, decoded_frames_memory));
+	log->info(get_name(), error->eprintf("uploads: %llu bytes last frame, %llu bytes peak, %u deferred, %llu bytes budget",
+		counters.frame_uploaded_bytes, counters.peak_frame_uploaded_bytes, deferred_uploads, UPLOAD_BUDGET));
+	log->info(get_name(), error->eprintf("frame cache: %u hits, %u misses, %.1f%% hit rate",
+		counters.cache_hits, counters.cache_misses, hit_rate));
+	log->info(get_name(), error->eprintf("update: %.3f ms last frame, %.3f ms peak, worst spawn %.3f ms",
+		counters.update_time * 1000.0, counters.peak_update_time * 1000.0, counters.worst_spawn_latency * 1000.0));
+	return 0;
+}
+
+/**
+ * Setup plugin runtime resources.
+ */
+void setup_plugin(GetApiFunction get_engine_api)
+{
+	setup_common_api(get_engine_api);
+
+	unit = (UnitApi*)get_engine_api(UNIT_API_ID);
+	render_buffer = (RenderBufferApi*)get_engine_api(RENDER_BUFFER_API_ID);
+	thread = (ThreadApi*)get_engine_api(THREAD_API_ID);
+	future_input_archive = (FutureInputArchiveApi*)get_engine_api(FUTURE_INPUT_ARCHIVE_API_ID);
+	input_archive = (InputArchiveApi*)get_engine_api(INPUT_ARCHIVE_API_ID);
+	input_buffer = (InputBufferApi*)get_engine_api(INPUT_BUFFER_API_ID);
+	auto c_api = (ScriptApi*)get_engine_api(C_API_ID);
+	stingray::Unit = c_api->Unit;
+	stingray::Mesh = c_api->Mesh;
+	stingray::Material = c_api->Material;
+	stingray::Data = c_api->DynamicScriptData;
+
+	giphies = MAKE_NEW(_allocator, Array<UnitGiphy>, _allocator);
+	giphy_slots = MAKE_NEW(_allocator, GiphySlots, _allocator);
+	giphy_target_cache = MAKE_NEW(_allocator, GiphyTargetCache, _allocator);
+	first_free_giphy = INVALID_HANDLE;
+	placeholder_pixels = MAKE_NEW(_allocator, Array<unsigned char>, _allocator);
+	expanded_pixels = MAKE_NEW(_allocator, Array<unsigned char>, _allocator);
+	gif_cache = MAKE_NEW(_allocator, GifCache, _allocator);
+	catch_up_rects = MAKE_NEW(_allocator, Array<const GifDirtyRect*>, _allocator);
+	giphy_schedule = MAKE_NEW(_allocator, DeadlineQueue, _allocator);
+	due_giphies = MAKE_NEW(_allocator, Array<unsigned>, _allocator);
+	queued_uploads = MAKE_NEW(_allocator, Array<QueuedUpload>, _allocator);
+	eviction_candidates = MAKE_NEW(_allocator, Array<GifCacheEntry*>, _allocator);
+	retired_upload_sources = MAKE_NEW(_allocator, Array<RetiredUploadSource>, _allocator);
+	texture_uploads = MAKE_NEW(_allocator, UploadQueue, render_buffer, _allocator);
+	render_thread_uploads.store(texture_uploads);
+	game_thread_id = std::this_thread::get_id();
+
+	lua = (LuaApi*)get_engine_api(LUA_API_ID);
+	lua->add_module_function("Giphy", "set_camera", lua_set_camera);
+	lua->add_module_function("Giphy", "clear_camera", lua_clear_camera);
+	lua->add_module_function("Giphy", "set_upload_budget", lua_set_upload_budget);
+	lua->add_module_function("Giphy", "upload_stats", lua_upload_stats);
+	lua->add_console_command("giphy_stats", lua_giphy_stats, "Print the giphy runtime counters",
+		"reset", "reset the counter totals and peaks", (void*)nullptr);
+	add_playback_module_functions();
+
+	unit_reference = (UnitReferenceApi*)get_engine_api(UNIT_REFERENCE_API_ID);
+	flow_nodes = (FlowNodesApi*)get_engine_api(FLOW_NODES_API_ID);
+	setup_playback_flow_nodes();
+}
+
+/**
+ * Setup plugin compiler resources.
+ */
+void setup_data_compiler(GetApiFunction get_engine_api)
+{
+	setup_common_api(get_engine_api);
+
+	#if _DEBUG
+		// Always trigger the resource compiler in debug mode.
+		srand(time(nullptr));
+		RESOURCE_VERSION = rand();
+	#endif
+
+	data_compiler = (DataCompilerApi*)get_engine_api(DATA_COMPILER_API_ID);
+	data_compile_params = (DataCompileParametersApi*)get_engine_api(DATA_COMPILE_PARAMETERS_API_ID);
+	data_compiler->add_compiler(RESOURCE_EXTENSION, RESOURCE_VERSION, gif_compiler);
+}
+
+/**
+ * Register the loader of GIF resources.
+ */
+void register_gif_resource_type()
+{
+	memset(&gif_resource_callbacks, 0, sizeof(gif_resource_callbacks));
+	gif_resource_callbacks.load = load_gif_resource;
+	gif_resource_callbacks.destroy = destroy_gif_resource;
+	gif_resource_callbacks.bring_in = bring_in_gif_resource;
+	gif_resource_callbacks.bring_out = bring_out_gif_resource;
+	resource_manager->register_type_with_callbacks(RESOURCE_EXTENSION, &gif_resource_callbacks);
+}
+
+/**
+ * Indicate to the resource manager that we'll be using our plugin resource type.
+ */
+void setup_resources(GetApiFunction get_engine_api)
+{
+	setup_common_api(get_engine_api);
+	input_archive = (InputArchiveApi*)get_engine_api(INPUT_ARCHIVE_API_ID);
+	thread = (ThreadApi*)get_engine_api(THREAD_API_ID);
+	if (loaded_resources_lock == nullptr)
+		loaded_resources_lock = thread->create_critical_section(allocator_object);
+	register_gif_resource_type();
+}
+
+
+/**
+ * Upload a whole frame to the texture buffer of a giphy.
+ */
+void upload_full_frame(const UnitGiphy& ug, const unsigned char* pixels)
+{
+	const auto& frames = ug.gif->frames;
+	auto format = frames.format;
+	if (ug.expand_palette) {
+		pixels = expand_pixels(frames, pixels, frames.width * frames.height);
+		format = GIF_FORMAT_R8G8B8A8;
+	}
+	const auto frame_size = gif_image_size(frames.width, frames.height, format);
+	texture_uploads->update_buffer(ug.texture_buffer_handle, frame_size, pixels, ug.expand_palette || ug.stream);
+	uploaded_bytes += frame_size;
+}
+
+/**
+ * Upload the rectangles that changed between the previous and current frame
+ * of a giphy. `data` holds the rectangles pixels from `data_offset`.
+ */
+void upload_rect(const UnitGiphy& ug, const GifDirtyRect& rect, const unsigned char* data, unsigned data_offset)
+{
+	uint32_t offset[3] = { rect.x, rect.y, 0 };
+	uint32_t size[3] = { rect.width, rect.height, 1 };
+	const unsigned char* pixels = data + (rect.data_offset - data_offset);
+	auto format = ug.gif->frames.format;
+	if (ug.expand_palette) {
+		pixels = expand_pixels(ug.gif->frames, pixels, rect.width * rect.height);
+		format = GIF_FORMAT_R8G8B8A8;
+	}
+	const auto rect_size = gif_image_size(rect.width, rect.height, format);
+	texture_uploads->update_texture(ug.texture_buffer_handle, offset, size, pixels, rect_size, ug.expand_palette || ug.stream);
+	uploaded_bytes += rect_size;
+}
+
+/**
+ * Upload the rectangles that changed between the previous and current frame
+ * of a giphy. `data` holds the rectangles pixels from `data_offset`.
+ */
+void upload_frame_rects(const UnitGiphy& ug, const unsigned char* data, unsigned data_offset)
+{
+	const auto& frames = ug.gif->frames;
+	const auto& delta = frames.deltas[ug.current_frame];
+	for (unsigned r = 0; r < delta.rect_count; ++r)
+		upload_rect(ug, frames.rects[delta.first_rect + r], data, data_offset);
+}
+
+/**
+ * Returns true if a rectangle lies inside another one.
+ */
+bool rect_contains(const GifDirtyRect& outer, const GifDirtyRect& inner)
+{
+	return inner.x >= outer.x && inner.y >= outer.y &&
+		inner.x + inner.width <= outer.x + outer.width && inner.y + inner.height <= outer.y + outer.height;
+}
+
+/**
+ * Bring the texture of a giphy from its last uploaded frame to its current
+ * frame. When frames were skipped, only the rectangles not covered by the
+ * rectangle of a later frame get uploaded.
+ */
+void upload_frame(const UnitGiphy& ug)
+{
+	const auto& frames = ug.gif->frames;
+	if (frames.deltas == nullptr) {
+		const auto frame_size = gif_image_size(frames.width, frames.height, frames.format);
+		texture_uploads->update_buffer(ug.texture_buffer_handle, frame_size, frames.data + (size_t)ug.current_frame * frame_size, false);
+		uploaded_bytes += frame_size;
+		return;
+	}
+
+	// Only upload the rectangles that changed from the previous frame.
+	const unsigned frame_count = frames.frame_count;
+	const unsigned frames_to_apply = (ug.current_frame + frame_count - ug.uploaded_frame) % frame_count;
+	if (frames_to_apply <= 1) {
+		upload_frame_rects(ug, frames.data, 0);
+		return;
+	}
+
+	// Gather the rectangles of the skipped frames from the latest, checking the
+	// first gathered ones, the latest, for coverage.
+	catch_up_rects->resize(0);
+	for (unsigned i = 0; i < frames_to_apply; ++i) {
+		const auto& delta = frames.deltas[(ug.current_frame + frame_count - i) % frame_count];
+		for (unsigned r = 0; r < delta.rect_count; ++r) {
+			const auto& rect = frames.rects[delta.first_rect + r];
+			const unsigned covering_rects = catch_up_rects->size() < MAX_CATCH_UP_COVERING_RECTS ? catch_up_rects->size() : MAX_CATCH_UP_COVERING_RECTS;
+			bool covered = false;
+			for (unsigned c = 0; c < covering_rects && !covered; ++c)
+				covered = rect_contains(*(*catch_up_rects)[c], rect);
+			if (!covered)
+				catch_up_rects->push_back(&rect);
+		}
+	}
+
+	// Upload them in playback order.
+	for (unsigned i = catch_up_rects->size(); i-- > 0;)
+		upload_rect(ug, *(*catch_up_rects)[i], frames.data, 0);
+}
+
+/**
+ * Returns false if a mesh is out of the camera view. Otherwise returns the
+ * minimum time between its texture updates, growing with its distance to the
+ * camera, and the ratio of the view height it covers.
+ */
+bool mesh_upload_interval(MeshPtr mesh, float& interval, float& screen_size)
+{
+	interval = 0.0f;
+	screen_size = 1.0f;
+	if (!playback_view_set)
+		return true;
+
+	auto bounds = stingray::Mesh->bounding_volume(mesh);
+	auto pose = stingray::Mesh->world_pose(mesh);
+	float center[3], radius, distance;
+	world_bounding_sphere(&bounds.min.x, &bounds.max.x, pose->v, center, radius);
+	if (!sphere_in_view(playback_view, center, radius, distance))
+		return false;
+
+	screen_size = radius / ((distance + radius) * playback_view.tan_half_fov_y);
+
+	if (distance > THROTTLE_FULL_RATE_DISTANCE) {
+		interval = (distance / THROTTLE_FULL_RATE_DISTANCE - 1.0f) * THROTTLE_UPLOAD_INTERVAL_STEP;
+		interval = interval < THROTTLE_MAX_UPLOAD_INTERVAL ? interval : THROTTLE_MAX_UPLOAD_INTERVAL;
+	}
+	return true;
+}
+
+/**
+ * Lowers the upload interval and raises the screen size to the ones of the
+ * visible meshes of a giphy. Returns false if none is visible.
+ */
+bool merge_targets_upload_interval(const UnitGiphy& ug, float& interval, float& screen_size)
+{
+	bool visible = false;
+	for (unsigned t = 0; t < ug.target_count; ++t) {
+		float target_interval, target_screen_size;
+		if (!mesh_upload_interval(ug.targets[t].mesh, target_interval, target_screen_size))
+			continue;
+		visible = true;
+		interval = target_interval < interval ? target_interval : interval;
+		screen_size = target_screen_size > screen_size ? target_screen_size : screen_size;
+	}
+	return visible;
+}
+
+/**
+ * Returns false if the giphy is out of the camera view, otherwise returns the
+ * minimum time between its texture updates and the ratio of the view height
+ * it covers. Giphies update as their most visible mesh, and giphies shared by
+ * units as the most visible mesh of all of them.
+ */
+bool giphy_upload_interval(const UnitGiphy& ug, float& interval, float& screen_size)
+{
+	if (!playback_view_set) {
+		interval = 0.0f;
+		screen_size = 1.0f;
+		return true;
+	}
+
+	interval = THROTTLE_MAX_UPLOAD_INTERVAL;
+	screen_size = 0.0f;
+	if (ug.unit_instance)
+		return merge_targets_upload_interval(ug, interval, screen_size);
+
+	bool visible = false;
+	for (unsigned member = ug.next_shared_member; member != INVALID_HANDLE; member = (*giphies)[member].next_shared_member)
+		visible = merge_targets_upload_interval((*giphies)[member], interval, screen_size) || visible;
+	return visible;
+}
+
+/**
+ * Returns the size of the key frame data of delta encoded or streamed frames.
+ */
+unsigned key_frame_data_size(const GifFrames& frames)
+{
+	return align_to(gif_image_size(frames.width, frames.height, frames.format), GIF_RESOURCE_DATA_ALIGN);
+}
+
+/**
+ * Returns the size of the rectangles data of a delta encoded or streamed frame.
+ */
+unsigned frame_data_size(const GifFrames& frames, unsigned frame)
+{
+	unsigned size = 0;
+	const auto& delta = frames.deltas[frame];
+	for (unsigned r = delta.first_rect; r < delta.first_rect + delta.rect_count; ++r)
+		size += align_to(gif_image_size(frames.rects[r].width, frames.rects[r].height, frames.format), GIF_RESOURCE_DATA_ALIGN);
+	return size;
+}
+
+/**
+ * Open the resource stream of streamed GIF frames. Enough data to hold
+ * STREAM_READ_AHEAD_FRAMES frames is read ahead of the playhead.
+ */
+GifFrameStream* open_frame_stream(uint64_t resource_id, const GifFrames& frames)
+{
+	auto stream = MAKE_NEW(_allocator, GifFrameStream);
+	stream->future_archive = resource_manager->new_open_stream_by_id(allocator_object, RESOURCE_ID.id(), resource_id);
+	stream->archive = nullptr;
+	stream->buffer = nullptr;
+
+	unsigned max_frame_data_size = 0;
+	for (unsigned f = 0; f < frames.frame_count; ++f) {
+		const auto size = frame_data_size(frames, f);
+		max_frame_data_size = size > max_frame_data_size ? size : max_frame_data_size;
+	}
+	const auto read_ahead_size = max_frame_data_size * STREAM_READ_AHEAD_FRAMES;
+	const auto key_frame_size = key_frame_data_size(frames);
+	stream->read_chunk_size = read_ahead_size > key_frame_size ? read_ahead_size : key_frame_size;
+	return stream;
+}
+
+/**
+ * Close the resource stream of streamed GIF frames.
+ */
+void close_frame_stream(GifFrameStream* stream)
+{
+	if (stream->archive)
+		future_input_archive->delete_archive(stream->archive, allocator_object);
+	else
+		future_input_archive->cancel(stream->future_archive);
+	resource_manager->delete_stream(stream->future_archive, allocator_object);
+	MAKE_DELETE(_allocator, stream);
+}
+
+/**
+ * Returns true if `size` bytes of frame data can be read from the stream.
+ * Never waits on pending reads, so playback holds the current frame rather
+ * than stall the game thread.
+ */
+bool stream_frame_data(GifFrameStream& stream, unsigned size)
+{
+	// Open the archive once the stream is ready.
+	if (stream.buffer == nullptr) {
+		if (!future_input_archive->ready(stream.future_archive))
+			return false;
+		stream.archive = future_input_archive->new_archive(stream.future_archive, allocator_object);
+		stream.buffer = input_archive->buffer(stream.archive);
+		input_buffer->set_read_chunk(stream.buffer, stream.read_chunk_size);
+	}
+
+	if (input_buffer->available(stream.buffer) >= size)
+		return true;
+
+	// Pick up completed reads, then request the missing bytes if no read is pending.
+	if (!input_buffer->can_flush_without_stalling(stream.buffer))
+		return false;
+	input_buffer->flush(stream.buffer, 0);
+	if (input_buffer->available(stream.buffer) < size && input_buffer->can_flush_without_stalling(stream.buffer))
+		input_buffer->flush(stream.buffer, size);
+	return input_buffer->available(stream.buffer) >= size;
+}
+
+/**
+ * Returns how long a frame is shown.
+ */
+double frame_delay(const GifFrames& frames, unsigned frame)
+{
+	const double delay = frames.delays[frame] / 100.0;
+	return delay > MIN_FRAME_DELAY ? delay : MIN_FRAME_DELAY;
+}
+
+/**
+ * Returns how long a frame of a giphy is shown at its playback speed.
+ */
+double playback_delay(const UnitGiphy& ug, unsigned frame)
+{
+	return frame_delay(ug.gif->frames, frame) / ug.speed;
+}
+
+/**
+ * Raises the giphy_loop_completed Flow unit event on the units listening to
+ * the loops of a giphy, or of the units sharing it.
+ */
+void notify_loop_completed(const UnitGiphy& ug)
+{
+	if (ug.unit_instance) {
+		if (ug.loop_events)
+			flow_nodes->trigger_external_unit_event(ug.unit_instance, LOOP_COMPLETED_EVENT_ID);
+		return;
+	}
+	for (unsigned member = ug.next_shared_member; member != INVALID_HANDLE; member = (*giphies)[member].next_shared_member)
+		notify_loop_completed((*giphies)[member]);
+}
+
+/**
+ * Advances the current frame of a giphy past all the frames which delays
+ * elapsed, skipping whole loops at once if far behind. Completed loops get
+ * notified once per update.
+ */
+void advance_frames(UnitGiphy& ug, double now)
+{
+	const double loop_start = ug.next_frame_time;
+	unsigned steps = 0;
+	bool loop_completed = false;
+	while (ug.next_frame_time <= now) {
+		ug.current_frame = (ug.current_frame + 1) % ug.frame_count;
+		loop_completed = loop_completed || ug.current_frame == 0;
+		ug.next_frame_time += playback_delay(ug, ug.current_frame);
+
+		// Back to the same frame after a loop, only the remaining time matters.
+		if (++steps == ug.frame_count && ug.next_frame_time <= now) {
+			const double loop_duration = ug.next_frame_time - loop_start;
+			ug.next_frame_time += floor((now - ug.next_frame_time) / loop_duration) * loop_duration;
+		}
+	}
+	if (loop_completed)
+		notify_loop_completed(ug);
+}
+
+/**
+ * Returns when a giphy next needs an update, once its texture is updated or
+ * throttled, or a negative time if it does not anymore. Paused giphies only
+ * need one to show the frame they were paused or sought to.
+ */
+double next_update_time(const UnitGiphy& ug)
+{
+	if (ug.frame_count < 2)
+		return -1.0;
+	if (ug.uploaded_frame != ug.current_frame && (ug.paused || ug.next_upload_time < ug.next_frame_time))
+		return ug.next_upload_time;
+	return ug.paused ? -1.0 : ug.next_frame_time;
+}
+
+/**
+ * Queues the texture update of a giphy, prioritized by the ratio of the view
+ * height it covers and how late the update is.
+ */
+void queue_upload(UnitGiphy& ug, float screen_size, float interval, double now)
+{
+	if (ug.upload_queued_time < 0.0)
+		ug.upload_queued_time = now;
+	const double late_steps = (now - ug.upload_queued_time) / UPLOAD_LATENESS_PRIORITY_STEP;
+	const int doublings = late_steps < UPLOAD_LATENESS_MAX_DOUBLINGS ? (int)late_steps : UPLOAD_LATENESS_MAX_DOUBLINGS;
+
+	QueuedUpload upload;
+	upload.slot = (unsigned)(&ug - giphies->begin());
+	upload.priority = ldexpf(screen_size, doublings);
+	upload.interval = interval;
+	queued_uploads->push_back(upload);
+}
+
+/**
+ * Playback a giphy which frame data is streamed in, queuing its texture
+ * updates once the frame data is streamed in. Returns when it next needs an
+ * update, or a negative time if it does not anymore.
+ */
+double update_streamed_giphy(UnitGiphy& ug, double now)
+{
+	const auto& frames = ug.gif->frames;
+	auto& stream = *ug.stream;
+
+	// Replace the placeholder with the key frame once streamed in.
+	if (!ug.playing) {
+		if (!stream_frame_data(stream, key_frame_data_size(frames)))
+			return now;
+	} else if (frames.frame_count < 2 || ug.paused) {
+		return -1.0;
+	}
+
+	// Pause off-screen giphies, their frame data can only be read in order.
+	float upload_interval, screen_size;
+	if (!giphy_upload_interval(ug, upload_interval, screen_size)) {
+		ug.upload_queued_time = -1.0;
+		if (ug.next_frame_time < now + VISIBILITY_CHECK_INTERVAL)
+			ug.next_frame_time = now + VISIBILITY_CHECK_INTERVAL;
+		return ug.next_frame_time;
+	}
+
+	if (ug.playing && ug.next_frame_time > now)
+		return ug.next_frame_time;
+	queue_upload(ug, screen_size, upload_interval, now);
+	return now;
+}
+
+/**
+ * Uploads the frames of a streamed giphy up to the current time. Returns when
+ * it next needs an update, or a negative time if it does not anymore.
+ */
+double upload_streamed_frames(UnitGiphy& ug, double now)
+{
+	const auto& frames = ug.gif->frames;
+	auto& stream = *ug.stream;
+
+	if (!ug.playing) {
+		const auto key_frame_size = key_frame_data_size(frames);
+		upload_full_frame(ug, (const unsigned char*)input_buffer->ptr(stream.buffer));
+		input_buffer->consume(stream.buffer, key_frame_size);
+
+		ug.playing = true;
+		ug.current_frame = 0;
+		ug.uploaded_frame = 0;
+		ug.next_frame_time = now + playback_delay(ug, 0);
+		if (frames.frame_count < 2 || ug.paused)
+			return -1.0;
+	}
+
+	// Every frame rectangles must be uploaded in order, so catch up at most a
+	// loop and drop the rest of the delay.
+	for (unsigned steps = 0; ug.next_frame_time <= now; ++steps) {
+		if (steps == frames.frame_count) {
+			ug.next_frame_time = now + playback_delay(ug, ug.current_frame);
+			break;
+		}
+
+		// Hold the current frame if the next one is not streamed in yet.
+		const auto next_frame = (ug.current_frame + 1) % frames.frame_count;
+		const auto size = frame_data_size(frames, next_frame);
+		if (!stream_frame_data(stream, size))
+			return now;
+
+		ug.current_frame = next_frame;
+		ug.uploaded_frame = next_frame;
+		const auto& delta = frames.deltas[next_frame];
+		if (delta.rect_count > 0) {
+			upload_frame_rects(ug, (const unsigned char*)input_buffer->ptr(stream.buffer), frames.rects[delta.first_rect].data_offset);
+			input_buffer->consume(stream.buffer, size);
+		}
+
+		// The first frame rectangles come last, loop back to the second frame ones.
+		if (next_frame == 0) {
+			input_buffer->set_position(stream.buffer, key_frame_data_size(frames));
+			notify_loop_completed(ug);
+		}
+
+		ug.next_frame_time += playback_delay(ug, next_frame);
+	}
+	return ug.next_frame_time;
+}
+
+/**
+ * Marks the frames of a GIF as used, and queues their decoding again if they
+ * were evicted. Returns false until the frames are decoded.
+ */
+bool use_decoded_frames(GifCacheEntry& gif)
+{
+	gif.last_used_time = playback_time;
+	if (gif.frames.data)
+		return true;
+	if (gif.decode_job == nullptr)
+		gif.decode_job = queue_decode_job(gif.resource);
+	return false;
+}
+
+/**
+ * Evict the decoded frames least recently used by giphies until they fit in
+ * the memory budget. Frames used this frame are kept.
+ */
+void evict_decoded_frames()
+{
+	if (decoded_frames_memory <= DECODED_FRAMES_MEMORY_BUDGET)
+		return;
+
+	eviction_candidates->clear();
+	for (auto it = gif_cache->begin(); it != gif_cache->end(); ++it) {
+		auto gif = it->second;
+		if (gif->frames.decoded_data && gif->last_used_time < playback_time)
+			eviction_candidates->push_back(gif);
+	}
+	std::sort(eviction_candidates->begin(), eviction_candidates->end(), [](const GifCacheEntry* a, const GifCacheEntry* b) {
+		return a->last_used_time < b->last_used_time;
+	});
+
+	for (unsigned i = 0; i < eviction_candidates->size() && decoded_frames_memory > DECODED_FRAMES_MEMORY_BUDGET; ++i) {
+		auto& frames = (*eviction_candidates)[i]->frames;
+		decoded_frames_memory -= decoded_frames_size(frames);
+		retire_upload_source(INVALID_HANDLE, frames.decoded_data);
+		frames.decoded_data = nullptr;
+		frames.data = nullptr;
+		(*eviction_candidates)[i]->evicted = true;
+	}
+}
+
+/**
+ * Playback a giphy up to the current time. Returns when it next needs an
+ * update, or a negative time if it does not anymore.
+ */
+double update_giphy(UnitGiphy& ug, double now)
+{
+	// Swap in the decoded frames once they are ready.
+	auto& gif = *ug.gif;
+	if (gif.decode_job) {
+		if (!decode_workers->is_done(&gif.decode_job->task))
+			return now;
+		finish_decode_job(gif);
+	}
+
+	// Streamed frames are read by each giphy as it plays.
+	if (ug.stream)
+		return update_streamed_giphy(ug, now);
+
+	// Giphies which frames could not be decoded keep showing the placeholder.
+	if (gif.frames.data == nullptr && !gif.evicted)
+		return -1.0;
+
+	// Play the frames which delays elapsed, even if the texture is not updated.
+	if (ug.playing && ug.frame_count > 1 && !ug.paused)
+		advance_frames(ug, now);
+
+	// Update the texture at a rate depending on the giphy visibility and
+	// distance, replacing the placeholder with the first frame to start playing.
+	if (!ug.playing || (ug.uploaded_frame != ug.current_frame && ug.next_upload_time <= now)) {
+		float upload_interval, screen_size;
+		if (!giphy_upload_interval(ug, upload_interval, screen_size)) {
+			ug.upload_queued_time = -1.0;
+			const double visibility_check_time = now + VISIBILITY_CHECK_INTERVAL;
+			if (ug.paused)
+				return visibility_check_time;
+			return ug.next_frame_time < visibility_check_time ? ug.next_frame_time : visibility_check_time;
+		}
+
+		// Switching the texture array frame is free, texture uploads wait for budget.
+		if (ug.texture_buffer_handle == INVALID_HANDLE && ug.playing) {
+			for (unsigned t = 0; t < ug.target_count; ++t)
+				stingray::Material->set_scalar(ug.targets[t].material, ug.frame_index_variable, (float)ug.current_frame);
+			ug.uploaded_frame = ug.current_frame;
+			ug.next_upload_time = now + upload_interval;
+		} else {
+			if (!use_decoded_frames(gif))
+				return now;
+			queue_upload(ug, screen_size, upload_interval, now);
+			return now;
+		}
+	}
+
+	return next_update_time(ug);
+}
+
+/**
+ * Upload the queued texture updates by priority until the upload budget is
+ * spent, at least the first one so budgets smaller than a frame still make
+ * progress. Deferred updates stay scheduled to be queued again next frame.
+ */
+void upload_queued_frames(double now)
+{
+	std::sort(queued_uploads->begin(), queued_uploads->end(), [](const QueuedUpload& a, const QueuedUpload& b) {
+		return a.priority > b.priority;
+	});
+
+	deferred_uploads = 0;
+	max_upload_lateness = 0.0;
+	for (unsigned i = 0; i < queued_uploads->size(); ++i) {
+		const auto& upload = (*queued_uploads)[i];
+		auto& ug = (*giphies)[upload.slot];
+		const double lateness = now - ug.upload_queued_time;
+		max_upload_lateness = lateness > max_upload_lateness ? lateness : max_upload_lateness;
+		if (i > 0 && UPLOAD_BUDGET > 0 && uploaded_bytes >= UPLOAD_BUDGET) {
+			++deferred_uploads;
+			continue;
+		}
+
+		ug.upload_queued_time = -1.0;
+		if (ug.stream) {
+			const auto next_time = upload_streamed_frames(ug, now);
+			if (next_time >= 0.0)
+				giphy_schedule->schedule(upload.slot, next_time);
+			continue;
+		}
+
+		// The first frame replaces the placeholder whole.
+		if (!ug.playing) {
+			ug.playing = true;
+			ug.current_frame = 0;
+			ug.next_frame_time = now + playback_delay(ug, 0);
+			upload_full_frame(ug, ug.gif->frames.data);
+		} else {
+			upload_frame(ug);
+		}
+		ug.uploaded_frame = ug.current_frame;
+		ug.next_upload_time = now + upload.interval;
+		const auto next_time = next_update_time(ug);
+		if (next_time >= 0.0)
+			giphy_schedule->schedule(upload.slot, next_time);
+	}
+	queued_uploads->clear();
+}
+
+/**
+ * Called per game frame.
+ * Each frame, playback the GIF animation of the giphies which next frame or
+ * texture update is due.
+ */
+void update_plugin(float dt)
+{
+	ProfileScope scope("giphy_update");
+	const auto start_ticks = timer->ticks();
+	playback_time += dt;
+	uploaded_bytes = 0;
+	release_retired_upload_sources(false);
+
+	{
+		ProfileScope schedule_scope("giphy_schedule");
+
+		// Collect the due giphies first, so the ones polling again at the current
+		// time get updated next frame.
+		due_giphies->clear();
+		while (!giphy_schedule->empty() && giphy_schedule->top_deadline() <= playback_time)
+			due_giphies->push_back(giphy_schedule->pop());
+
+		for (unsigned i = 0; i < due_giphies->size(); ++i) {
+			const auto slot = (*due_giphies)[i];
+			const auto next_update_time = update_giphy((*giphies)[slot], playback_time);
+			if (next_update_time >= 0.0)
+				giphy_schedule->schedule(slot, next_update_time);
+		}
+	}
+
+	{
+		ProfileScope upload_scope("giphy_upload");
+		upload_queued_frames(playback_time);
+	}
+	evict_decoded_frames();
+	texture_uploads->submit();
+
+	counters.frame_uploaded_bytes = uploaded_bytes;
+	if (uploaded_bytes > counters.peak_frame_uploaded_bytes)
+		counters.peak_frame_uploaded_bytes = uploaded_bytes;
+	counters.update_time = timer->ticks_to_seconds(timer->ticks() - start_ticks);
+	if (counters.update_time > counters.peak_update_time)
+		counters.peak_update_time = counters.update_time;
+}
+
+/**
+* Release giphy data and mark slot as unused.
+*/
+void release_giphy(UnitGiphy& giphy)
+{
+	// Mark this slot as unused, so reusable.
+	const auto slot = (unsigned)(&giphy - giphies->begin());
+	giphy.used = false;
+	giphy.next_free = first_free_giphy;
+	first_free_giphy = slot;
+	giphy_schedule->remove(slot);
+	if (giphy.unit_instance)
+		giphy_slots->erase(giphy.unit_instance);
+	else
+		giphy.gif->shared_giphy = INVALID_HANDLE;
+
+	// Stop sharing the giphy, releasing it along with the last unit sharing it.
+	if (giphy.shared_slot != INVALID_HANDLE) {
+		auto& shared = (*giphies)[giphy.shared_slot];
+		unsigned* link = &shared.next_shared_member;
+		while (*link != slot)
+			link = &(*giphies)[*link].next_shared_member;
+		*link = giphy.next_shared_member;
+		giphy.shared_slot = INVALID_HANDLE;
+		if (shared.next_shared_member == INVALID_HANDLE)
+			release_giphy(shared);
+	}
+
+	// Close the frame data stream.
+	if (giphy.stream) {
+		close_frame_stream(giphy.stream);
+		giphy.stream = nullptr;
+	}
+
+	// Release the GIF animation frames, disposing of them if no other giphy uses them.
+	release_gif(giphy.gif);
+	giphy.gif = nullptr;
+
+	// Release the texture buffer resource, if not playing from the shared texture array.
+	if (giphy.texture_buffer_handle != INVALID_HANDLE)
+		retire_upload_source(giphy.texture_buffer_handle, nullptr);
+	giphy.texture_buffer_handle = INVALID_HANDLE;
+}
+
+/**
+ * Delete the containers indexing giphies and shared frames, and the scratch
+ * buffers of the runtime.
+ */
+void delete_runtime_containers()
+{
+	// Execute the texture updates left before their sources get released.
+	if (texture_uploads) {
+		drain_texture_uploads();
+		release_retired_upload_sources(true);
+		MAKE_DELETE(_allocator, texture_uploads);
+		texture_uploads = nullptr;
+	}
+	MAKE_DELETE(_allocator, retired_upload_sources);
+	retired_upload_sources = nullptr;
+
+	MAKE_DELETE(_allocator, giphies);
+	giphies = nullptr;
+	MAKE_DELETE(_allocator, giphy_slots);
+	giphy_slots = nullptr;
+	MAKE_DELETE(_allocator, giphy_target_cache);
+	giphy_target_cache = nullptr;
+	MAKE_DELETE(_allocator, gif_cache);
+	gif_cache = nullptr;
+	MAKE_DELETE(_allocator, decode_workers);
+	decode_workers = nullptr;
+	MAKE_DELETE(_allocator, placeholder_pixels);
+	placeholder_pixels = nullptr;
+	MAKE_DELETE(_allocator, expanded_pixels);
+	expanded_pixels = nullptr;
+	MAKE_DELETE(_allocator, catch_up_rects);
+	catch_up_rects = nullptr;
+	MAKE_DELETE(_allocator, giphy_schedule);
+	giphy_schedule = nullptr;
+	MAKE_DELETE(_allocator, due_giphies);
+	due_giphies = nullptr;
+	MAKE_DELETE(_allocator, queued_uploads);
+	queued_uploads = nullptr;
+	MAKE_DELETE(_allocator, eviction_candidates);
+	eviction_candidates = nullptr;
+}
+
+/**
+ * Release plugin resources.
+ */
+void shutdown_plugin()
+{
+	if (giphies) {
+		// Shared giphies get released along with their last unit.
+		for (unsigned i = 0; i < giphies->size(); ++i) {
+			auto& ug = (*giphies)[i];
+			if (!ug.used || !ug.unit_instance)
+				continue;
+			release_giphy(ug);
+		}
+
+		// Release the frames still held by loaded resources, brought out later.
+		eviction_candidates->clear();
+		for (auto it = gif_cache->begin(); it != gif_cache->end(); ++it)
+			eviction_candidates->push_back(it->second);
+		for (unsigned i = 0; i < eviction_candidates->size(); ++i) {
+			if ((*eviction_candidates)[i]->loaded_resource)
+				bring_out_gif_resource(nullptr, (*eviction_candidates)[i]->loaded_resource);
+		}
+	}
+
+	delete_runtime_containers();
+
+	if (lua) {
+		lua->remove_all_module_entries("Giphy");
+		lua->deprecated_error("Console", "giphy_stats", "The giphy plugin is unloaded");
+		lua = nullptr;
+	}
+
+	if (flow_nodes) {
+		unregister_playback_flow_nodes();
+		flow_nodes = nullptr;
+	}
+
+	// Free the frames resources decoded while loading, they get decoded again
+	// by the next game if still loaded then.
+	if (loaded_resources_lock) {
+		thread->enter_critical_section(loaded_resources_lock);
+		for (auto loaded = loaded_resources; loaded; ) {
+			auto next = loaded->next_loaded;
+			if (loaded->frames.data == loaded->frames.decoded_data)
+				loaded->frames.data = nullptr;
+			STBI_FREE(loaded->frames.decoded_data);
+			loaded->frames.decoded_data = nullptr;
+			loaded->previous_loaded = nullptr;
+			loaded->next_loaded = nullptr;
+			loaded = next;
+		}
+		loaded_resources = nullptr;
+		thread->leave_critical_section(loaded_resources_lock);
+		thread->destroy_critical_section(loaded_resources_lock, allocator_object);
+		loaded_resources_lock = nullptr;
 	}
 
 	if (allocator_object != nullptr) {
@@ -320,148 +2161,1137 @@ void shutdown_plugin()
 }
 
 /**
-* Searches for a unit's giphy.
+ * Called by the render thread when it begins a frame, to execute the texture
+ * updates submitted by the game thread.
+ */
+void render_begin_frame()
+{
+	// Flag the queue as used before getting it, so the game thread either
+	// sees the flag or detached the queue already.
+	render_thread_executes_uploads.store(true);
+	auto uploads = render_thread_uploads.load();
+	if (uploads) {
+		ProfileScope scope("giphy_execute_uploads");
+		uploads->execute();
+	}
+	render_thread_executes_uploads.store(false, std::memory_order_release);
+}
+
+/**
+* Searches for a unit's giphy.
+*/
+UnitGiphy* find_giphy(CApiUnit* unit)
+{
+	auto it = giphy_slots->find(unit);
+	if (it == giphy_slots->end())
+		return nullptr;
+	return &(*giphies)[it->second];
+}
+
+/**
+* Returns true if a unit has a script data flag set.
+*/
+bool script_data_flag(CApiUnitRef unit_ref, const char* name)
+{
+	if (!stingray::Data->Unit->has_data(unit_ref, 1, name))
+		return false;
+	auto item = stingray::Data->Unit->get_data(unit_ref, 1, name);
+	if (item.type == D_DATA_NUMBER_TYPE)
+		return *(const float*)item.pointer != 0.0f;
+	return item.type == D_DATA_BOOLEAN_TYPE && *(const char*)item.pointer != 0;
+}
+
+/**
+* Adds a mesh and the material of it named, or its first material if no name
+* is given, to the giphy targets of a unit type. Invalid targets are ignored.
+*/
+void add_giphy_target(GiphyTargetIndices& indices, CApiUnitRef unit_ref, unsigned mesh_index, const char* material_name, unsigned material_name_length)
+{
+	if (mesh_index >= stingray::Unit->num_meshes(unit_ref) || indices.count == MAX_GIPHY_TARGETS)
+		return;
+
+	auto mesh = stingray::Unit->mesh(unit_ref, mesh_index, nullptr);
+	unsigned material_index = 0;
+	if (material_name_length > 0)
+		material_index = stingray::Mesh->find_material(mesh, IdString32(material_name_length, material_name).id());
+	if (material_index >= stingray::Mesh->num_materials(mesh))
+		return;
+
+	indices.mesh_index[indices.count] = mesh_index;
+	indices.material_index[indices.count] = material_index;
+	++indices.count;
+}
+
+/**
+* Returns the mesh and material indices of the giphy targets of a unit,
+* resolved the first time a unit of its type spawns. Targets are listed by the
+* giphy_targets script data as "mesh_index:material_name" entries separated by
+* spaces or commas, an entry without material name using the first material.
+* Otherwise the giphy shows on the first material of the giphy_mesh_index mesh.
+* Returns null if the unit has no valid target.
+*/
+const GiphyTargetIndices* giphy_target_indices(CApiUnit* unit_instance, CApiUnitRef unit_ref)
+{
+	const auto unit_type = unit->unit_resource_name(unit_instance);
+	auto it = giphy_target_cache->find(unit_type);
+	if (it != giphy_target_cache->end())
+		return it->second.count > 0 ? &it->second : nullptr;
+
+	GiphyTargetIndices indices;
+	indices.count = 0;
+
+	if (stingray::Data->Unit->has_data(unit_ref, 1, "giphy_targets")) {
+		auto list = (const char*)stingray::Data->Unit->get_data(unit_ref, 1, "giphy_targets").pointer;
+		for (;;) {
+			while (*list == ' ' || *list == ',')
+				++list;
+			char* end;
+			const auto mesh_index = (unsigned)strtoul(list, &end, 10);
+			if (end == list)
+				break;
+			list = end;
+			const char* material_name = list;
+			if (*list == ':') {
+				material_name = ++list;
+				while (*list && *list != ' ' && *list != ',')
+					++list;
+			}
+			add_giphy_target(indices, unit_ref, mesh_index, material_name, (unsigned)(list - material_name));
+		}
+	} else if (stingray::Data->Unit->has_data(unit_ref, 1, "giphy_mesh_index")) {
+		add_giphy_target(indices, unit_ref, (unsigned)*(float*)stingray::Data->Unit->get_data(unit_ref, 1, "giphy_mesh_index").pointer, "", 0);
+	}
+
+	giphy_target_cache->insert(unit_type, indices);
+	return indices.count > 0 ? &giphy_target_cache->find(unit_type)->second : nullptr;
+}
+
+/**
+* Binds a resource to a material slot of all the targets of a giphy.
+*/
+void set_targets_resource(const GiphyTarget* targets, unsigned target_count, unsigned slot_id, void* resource)
+{
+	for (unsigned t = 0; t < target_count; ++t)
+		stingray::Material->set_resource(targets[t].material, slot_id, resource);
+}
+
+/**
+* Track a giphy in the last released slot, if any.
+*/
+unsigned add_giphy(const UnitGiphy& ug)
+{
+	unsigned slot = first_free_giphy;
+	if (slot != INVALID_HANDLE) {
+		first_free_giphy = (*giphies)[slot].next_free;
+		(*giphies)[slot] = ug;
+	} else {
+		slot = giphies->size();
+		giphies->push_back(ug);
+	}
+	return slot;
+}
+
+/**
+* Creates the giphy of a unit, displaying a GIF resource or the one of its
+* script data if 0, and updates its mesh materials. Returns false if the
+* unit cannot display it.
+*/
+bool spawn_giphy(CApiUnit* unit_instance, uint64_t giphy_resource_id)
+{
+	#if _DEBUG
+		#define LOG_AND_RETURN(msg, ...) { log->warning(RESOURCE_EXTENSION, error->eprintf(msg, ##__VA_ARGS__)); return false; }
+	#else
+		#define LOG_AND_RETURN(msg, ...) { return false; }
+	#endif
+
+	auto unit_ref = unit->reference(unit_instance);
+
+	#if _DEBUG
+		auto unit_resource_name = unit->unit_resource_name(unit_instance);
+	#endif
+
+	// Define script data field name to get.
+	const auto giphy_resource_indice = "giphy_resource";
+	const auto material_slot_name_indice = "giphy_material_slot_name";
+	const auto frame_index_variable_indice = "giphy_frame_index_variable";
+	const auto palette_slot_name_indice = "giphy_palette_slot_name";
+	const auto shared_clock_indice = "giphy_shared_clock";
+
+	// Do not continue if this unit does not have any Giphy resource.
+	if (giphy_resource_id == 0) {
+		if (!stingray::Data->Unit->has_data(unit_ref, 1, giphy_resource_indice))
+			return false;
+		giphy_resource_id = IdString64((const char*)stingray::Data->Unit->get_data(unit_ref, 1, giphy_resource_indice).pointer).id();
+	}
+
+	// Make sure the unit has all the data we need to display a Giphy on it.
+	if (stingray::Unit->num_meshes(unit_ref) == 0 ||
+		!stingray::Data->Unit->has_data(unit_ref, 1, material_slot_name_indice))
+		LOG_AND_RETURN("Unit #ID[%016llx] is missing Giphy property script data.", unit_resource_name);
+
+	// Get script data values
+	auto giphy_material_slot_name = (const char*)stingray::Data->Unit->get_data(unit_ref, 1, material_slot_name_indice).pointer;
+
+	// We need a valid material slot name
+	if (strlen(giphy_material_slot_name) == 0)
+		LOG_AND_RETURN("Unit #ID[%016llx] has an invalid material slot name", unit_resource_name);
+
+	// Make sure we can load the Giphy resource.
+	if (!resource_manager->can_get_by_id(RESOURCE_ID.id(), giphy_resource_id))
+		LOG_AND_RETURN("Cannot get unit #ID[%016llx] giphy resource", unit_resource_name);
+
+	// Get the unit meshes and materials on which to display the Giphy.
+	auto target_indices = giphy_target_indices(unit_instance, unit_ref);
+	if (target_indices == nullptr)
+		LOG_AND_RETURN("Unit #ID[%016llx] has no valid giphy mesh and material", unit_resource_name);
+	GiphyTarget targets[MAX_GIPHY_TARGETS];
+	const auto target_count = target_indices->count;
+	for (unsigned t = 0; t < target_count; ++t) {
+		targets[t].mesh = stingray::Unit->mesh(unit_ref, target_indices->mesh_index[t], nullptr);
+		targets[t].material = stingray::Mesh->material(targets[t].mesh, target_indices->material_index[t]);
+	}
+
+	// Get the GIF resource frames, shared by all the units displaying them.
+	auto gif_resource = (GifLoadedResource*)resource_manager->get_by_id(RESOURCE_ID.id(), giphy_resource_id);
+	auto gif = acquire_gif(giphy_resource_id, gif_resource);
+	if (gif == nullptr)
+		LOG_AND_RETURN("Cannot parse unit #ID[%016llx] giphy resource data", unit_resource_name);
+
+	// Giphies with a frame index material variable play from a texture array
+	// shared with other units, if it fits in the budget.
+	const auto& frames = gif->frames;
+	auto material_slot_id = IdString32(giphy_material_slot_name).id();
+
+	// Indexed frames are sampled through a palette texture if the material
+	// has a slot for it, otherwise they get expanded on upload.
+	bool expand_palette = false;
+	if (frames.format == GIF_FORMAT_INDEXED8) {
+		const char* palette_slot_name = "";
+		if (stingray::Data->Unit->has_data(unit_ref, 1, palette_slot_name_indice))
+			palette_slot_name = (const char*)stingray::Data->Unit->get_data(unit_ref, 1, palette_slot_name_indice).pointer;
+		if (strlen(palette_slot_name) > 0) {
+			create_palette_texture(*gif);
+			set_targets_resource(targets, target_count, IdString32(palette_slot_name).id(), render_buffer->lookup_resource(gif->palette_handle));
+		} else {
+			expand_palette = true;
+		}
+	}
+
+	unsigned frame_index_variable = 0;
+	if (!expand_palette && stingray::Data->Unit->has_data(unit_ref, 1, frame_index_variable_indice)) {
+		auto frame_index_variable_name = (const char*)stingray::Data->Unit->get_data(unit_ref, 1, frame_index_variable_indice).pointer;
+		if (strlen(frame_index_variable_name) > 0 && create_texture_array(*gif))
+			frame_index_variable = IdString32(frame_index_variable_name).id();
+	}
+
+	// Units sharing their clock display the texture of the giphy playing the
+	// GIF for all of them, created along with the first one.
+	bool shared_clock = !frame_index_variable && script_data_flag(unit_ref, shared_clock_indice);
+	if (shared_clock && gif->shared_giphy != INVALID_HANDLE && (*giphies)[gif->shared_giphy].expand_palette != expand_palette)
+		shared_clock = false;
+	const bool share_existing = shared_clock && gif->shared_giphy != INVALID_HANDLE;
+
+	auto texture_buffer_handle = INVALID_HANDLE;
+	if (frame_index_variable) {
+		set_targets_resource(targets, target_count, material_slot_id, render_buffer->lookup_resource(gif->texture_array_handle));
+		for (unsigned t = 0; t < target_count; ++t)
+			stingray::Material->set_scalar(targets[t].material, frame_index_variable, 0.0f);
+	} else if (share_existing) {
+		auto shared_texture_handle = (*giphies)[gif->shared_giphy].texture_buffer_handle;
+		set_targets_resource(targets, target_count, material_slot_id, render_buffer->lookup_resource(shared_texture_handle));
+	} else {
+		// Source encoded frames get decoded by a worker and streamed frames read
+		// while playing, show transparent pixels until then.
+		const auto texture_pixel_format = expand_palette ? (unsigned)GIF_FORMAT_R8G8B8A8 : frames.format;
+		auto frame_size = gif_image_size(frames.width, frames.height, texture_pixel_format);
+		const unsigned char* initial_pixels = frames.data;
+		if (expand_palette && frames.data) {
+			initial_pixels = expand_pixels(frames, frames.data, frames.width * frames.height);
+		} else if (initial_pixels == nullptr) {
+			if (placeholder_pixels->size() < frame_size) {
+				placeholder_pixels->resize(frame_size);
+				memset(placeholder_pixels->begin(), 0, frame_size);
+			}
+			initial_pixels = placeholder_pixels->begin();
+		}
+
+		// Create texture buffer view
+		RB_TextureBufferView texture_buffer_view;
+		memset(&texture_buffer_view, 0, sizeof(texture_buffer_view));
+		texture_buffer_view.width = frames.width;
+		texture_buffer_view.height = frames.height;
+		texture_buffer_view.depth = 1;
+		texture_buffer_view.mip_levels = 1;
+		texture_buffer_view.slices = 1;
+		texture_buffer_view.type = RB_TEXTURE_TYPE_2D;
+		texture_buffer_view.format = texture_format(texture_pixel_format);
+
+		// Create and initialize texture buffer with first GIF frame.
+		texture_buffer_handle = render_buffer->create_buffer(frame_size, RB_VALIDITY_UPDATABLE, RB_TEXTURE_BUFFER_VIEW, &texture_buffer_view, initial_pixels);
+		auto texture_buffer = render_buffer->lookup_resource(texture_buffer_handle);
+
+		// Update the mesh materials with the newly created texture buffer resource.
+		set_targets_resource(targets, target_count, material_slot_id, texture_buffer);
+	}
+
+	// Associate and track the Giphy data for this unit.
+	UnitGiphy ug;
+	ug.used = true;
+	ug.next_free = INVALID_HANDLE;
+	ug.unit_instance = unit_instance;
+	ug.gif = gif;
+	ug.stream = frames.streamed && !share_existing ? open_frame_stream(giphy_resource_id, frames) : nullptr;
+	ug.texture_buffer_handle = texture_buffer_handle;
+	ug.expand_palette = expand_palette;
+	memcpy(ug.targets, targets, sizeof(targets));
+	ug.target_count = target_count;
+	ug.shared_slot = INVALID_HANDLE;
+	ug.next_shared_member = INVALID_HANDLE;
+	ug.frame_index_variable = frame_index_variable;
+
+	// Initialize playback data.
+	ug.playing = frames.data != nullptr;
+	ug.current_frame = 0;
+	ug.frame_count = frames.frame_count;
+	ug.paused = false;
+	ug.speed = 1.0f;
+	ug.paused_frame_time_left = 0.0;
+	ug.loop_events = false;
+	ug.next_frame_time = playback_time + playback_delay(ug, 0);
+	ug.uploaded_frame = 0;
+	ug.next_upload_time = 0.0;
+	ug.upload_queued_time = -1.0;
+
+	// The first unit sharing its clock hands its texture and stream over
+	// to a giphy without unit, playing for all of them.
+	if (shared_clock) {
+		if (!share_existing) {
+			UnitGiphy shared = ug;
+			shared.unit_instance = nullptr;
+			shared.target_count = 0;
+			++gif->ref_count;
+			gif->shared_giphy = add_giphy(shared);
+			giphy_schedule->schedule(gif->shared_giphy, playback_time);
+		}
+		ug.stream = nullptr;
+		ug.texture_buffer_handle = INVALID_HANDLE;
+		ug.shared_slot = gif->shared_giphy;
+	}
+
+	const auto slot = add_giphy(ug);
+	giphy_slots->insert(unit_instance, slot);
+
+	// Update the giphy next frame, unless shared.
+	if (shared_clock) {
+		auto& shared = (*giphies)[gif->shared_giphy];
+		(*giphies)[slot].next_shared_member = shared.next_shared_member;
+		shared.next_shared_member = slot;
+	} else {
+		giphy_schedule->schedule(slot, playback_time);
+	}
+	return true;
+}
+
+/**
+* When new units spawn, we check if they have a giphy resource assigned and
+* update their respective mesh material.
+*/
+void units_spawned(CApiUnit **units, unsigned count)
+{
+	log->info(get_name(), error->eprintf("unit_spawned called %u", count));
+
+	ProfileScope scope("giphy_units_spawned");
+	for (unsigned i = 0; i < count; ++i) {
+		const auto start_ticks = timer->ticks();
+		if (!spawn_giphy(units[i], 0))
+			continue;
+		const auto latency = timer->ticks_to_seconds(timer->ticks() - start_ticks);
+		if (latency > counters.worst_spawn_latency)
+			counters.worst_spawn_latency = latency;
+	}
+}
+
+/**
+* When units gets unspawned, lets if we have a associated giphy, if yes,
+* lets release it.
 */
-UnitGiphy* find_giphy(CApiUnit* unit)
+void units_unspawned(CApiUnit **units, unsigned count)
 {
-	for (unsigned g = 0; g < giphies->size(); ++g) {
-		auto& ug = (*giphies)[g];
-		if (ug.used && ug.unit_instance == unit)
-			return &ug;
+	ProfileScope scope("giphy_units_unspawned");
+
+	// Stop looking up units once no giphy is left, as on level teardown.
+	for (unsigned i = 0; i < count && !giphy_slots->empty(); ++i) {
+		auto unit = units[i];
+		auto unit_giphy = find_giphy(unit);
+		if (unit_giphy)
+			release_giphy(*unit_giphy);
 	}
-	return nullptr;
 }
 
 /**
-* When new units spawn, we check if they have a giphy resource assigned and
-* update their respective mesh material.
+* Returns the giphy playing for a unit, shared by all the units sharing its
+* clock if any, or null if the unit has no giphy.
 */
-void units_spawned(CApiUnit **units, unsigned count)
+UnitGiphy* playback_giphy(CApiUnit* unit_instance)
 {
-	log->info(get_name(), error->eprintf("unit_spawned called %u", count));
+	auto ug = find_giphy(unit_instance);
+	if (ug && ug->shared_slot != INVALID_HANDLE)
+		return &(*giphies)[ug->shared_slot];
+	return ug;
+}
 
-	#if _DEBUG
-		#define LOG_AND_CONTINUE(msg, ...) { log->warning(RESOURCE_EXTENSION, error->eprintf(msg, ##__VA_ARGS__)); continue; }
-	#else
-		#define LOG_AND_CONTINUE(msg, ...) { continue;  }
-	#endif
+/**
+* Resumes a paused giphy where it was paused.
+*/
+void play_giphy(UnitGiphy& ug)
+{
+	if (!ug.paused)
+		return;
+	ug.paused = false;
+	ug.next_frame_time = playback_time + ug.paused_frame_time_left;
+	giphy_schedule->schedule((unsigned)(&ug - giphies->begin()), playback_time);
+}
 
-	for (unsigned i = 0; i < count; ++i) {
-		auto unit_ref = unit->reference(units[i]);
+/**
+* Holds the current frame of a giphy, once shown, until played again.
+*/
+void pause_giphy(UnitGiphy& ug)
+{
+	if (ug.paused)
+		return;
+	const double time_left = ug.next_frame_time - playback_time;
+	ug.paused = true;
+	ug.paused_frame_time_left = time_left > 0.0 ? time_left : 0.0;
+}
+
+/**
+* Scales the frame delays of a giphy, including the time the current frame
+* has left.
+*/
+void set_giphy_speed(UnitGiphy& ug, float speed)
+{
+	speed = speed > MIN_PLAYBACK_SPEED ? speed : MIN_PLAYBACK_SPEED;
+	const double scale = ug.speed / speed;
+	ug.speed = speed;
+	if (ug.paused) {
+		ug.paused_frame_time_left *= scale;
+		return;
+	}
 
-		#if _DEBUG
-			auto unit_resource_name = unit->unit_resource_name(units[i]);
-		#endif
+	const double time_left = ug.next_frame_time - playback_time;
+	if (time_left > 0.0)
+		ug.next_frame_time = playback_time + time_left * scale;
+	giphy_schedule->schedule((unsigned)(&ug - giphies->begin()), playback_time);
+}
 
-		// Define script data field name to get.
-		const auto giphy_resource_indice = "giphy_resource";
-		const auto mesh_index_indice = "giphy_mesh_index";
-		const auto material_slot_name_indice = "giphy_material_slot_name";
+/**
+* Jumps to the frame shown at a time of the GIF loop, in seconds at normal
+* speed. Returns false for giphies not playing yet and streamed giphies,
+* which frame data can only be read in order.
+*/
+bool seek_giphy(UnitGiphy& ug, double time)
+{
+	if (ug.stream || !ug.playing)
+		return false;
+	if (ug.frame_count < 2)
+		return true;
+
+	const auto& frames = ug.gif->frames;
+	double loop_duration = 0.0;
+	for (unsigned frame = 0; frame < ug.frame_count; ++frame)
+		loop_duration += frame_delay(frames, frame);
+	time = fmod(time, loop_duration);
+	if (time < 0.0)
+		time += loop_duration;
+
+	unsigned frame = 0;
+	double frame_end_time = frame_delay(frames, 0);
+	while (frame_end_time <= time && frame + 1 < ug.frame_count)
+		frame_end_time += frame_delay(frames, ++frame);
+
+	// Show the frame right away, whatever the texture update rate.
+	ug.current_frame = frame;
+	ug.next_upload_time = playback_time;
+	const double time_left = (frame_end_time - time) / ug.speed;
+	if (ug.paused)
+		ug.paused_frame_time_left = time_left;
+	else
+		ug.next_frame_time = playback_time + time_left;
+	giphy_schedule->schedule((unsigned)(&ug - giphies->begin()), playback_time);
+	return true;
+}
 
-		// Do not continue if this unit does not have any Giphy resource.
-		if (!stingray::Data->Unit->has_data(unit_ref, 1, giphy_resource_indice))
+/**
+* Replaces the frames of a giphy by the ones of another GIF resource of the
+* same size and format, keeping its texture buffer. Returns false if the
+* texture does not fit them or is not the giphy's own, or if indexed frames
+* have no palette slot to sample from.
+*/
+bool swap_giphy_frames(UnitGiphy& ug, const char* resource_name)
+{
+	if (ug.unit_instance == nullptr || ug.texture_buffer_handle == INVALID_HANDLE)
+		return false;
+
+	auto gif_resource = (GifLoadedResource*)resource_manager->get(RESOURCE_EXTENSION, resource_name);
+	const auto resource_id = IdString64(resource_name).id();
+	auto gif = acquire_gif(resource_id, gif_resource);
+	if (gif == nullptr)
+		return false;
+
+	const auto& previous_frames = ug.gif->frames;
+	const auto& frames = gif->frames;
+	if (frames.width != previous_frames.width || frames.height != previous_frames.height || frames.format != previous_frames.format) {
+		release_gif(gif);
+		return false;
+	}
+
+	// Indexed frames sampled through a palette texture need the new palette.
+	if (frames.format == GIF_FORMAT_INDEXED8 && !ug.expand_palette) {
+		const auto palette_slot_name_indice = "giphy_palette_slot_name";
+		auto unit_ref = unit->reference(ug.unit_instance);
+		const char* palette_slot_name = "";
+		if (stingray::Data->Unit->has_data(unit_ref, 1, palette_slot_name_indice))
+			palette_slot_name = (const char*)stingray::Data->Unit->get_data(unit_ref, 1, palette_slot_name_indice).pointer;
+		if (strlen(palette_slot_name) == 0) {
+			release_gif(gif);
+			return false;
+		}
+		create_palette_texture(*gif);
+		set_targets_resource(ug.targets, ug.target_count, IdString32(palette_slot_name).id(), render_buffer->lookup_resource(gif->palette_handle));
+	}
+
+	// Texture updates already submitted keep the previous frames alive until executed.
+	if (ug.stream)
+		close_frame_stream(ug.stream);
+	release_gif(ug.gif);
+	ug.gif = gif;
+	ug.stream = frames.streamed ? open_frame_stream(resource_id, frames) : nullptr;
+
+	// Restart playback, showing the previous frame until the first one is uploaded.
+	ug.playing = false;
+	ug.frame_count = frames.frame_count;
+	ug.current_frame = 0;
+	ug.uploaded_frame = 0;
+	ug.next_frame_time = playback_time + playback_delay(ug, 0);
+	ug.paused_frame_time_left = playback_delay(ug, 0);
+	ug.next_upload_time = 0.0;
+	ug.upload_queued_time = -1.0;
+	giphy_schedule->schedule((unsigned)(&ug - giphies->begin()), playback_time);
+	return true;
+}
+
+/**
+* Makes a unit display another GIF resource, in place if its texture fits the
+* new frames, otherwise creating its giphy again. Returns false if the unit
+* cannot display it.
+*/
+bool set_giphy_resource(CApiUnit* unit_instance, const char* resource_name)
+{
+	if (resource_name == nullptr || !resource_manager->can_get(RESOURCE_EXTENSION, resource_name))
+		return false;
+
+	auto ug = find_giphy(unit_instance);
+	bool loop_events = false;
+	if (ug) {
+		if (ug->gif->resource_id == IdString64(resource_name).id() || swap_giphy_frames(*ug, resource_name))
+			return true;
+		loop_events = ug->loop_events;
+		release_giphy(*ug);
+	}
+	if (!spawn_giphy(unit_instance, IdString64(resource_name).id()))
+		return false;
+	find_giphy(unit_instance)->loop_events = loop_events;
+	return true;
+}
+
+/**
+* Unit giphy to spawn again, with the resource and playback state it had.
+*/
+struct GiphyRespawn
+{
+	CApiUnit* unit_instance;
+	uint64_t resource_id;
+	bool paused;
+	float speed;
+	bool loop_events;
+};
+
+/**
+* Returns what it takes to spawn the giphy of a unit again as it plays.
+*/
+GiphyRespawn giphy_respawn(const UnitGiphy& ug)
+{
+	const auto& playback = ug.shared_slot != INVALID_HANDLE ? (*giphies)[ug.shared_slot] : ug;
+	GiphyRespawn respawn;
+	respawn.unit_instance = ug.unit_instance;
+	respawn.resource_id = ug.gif->resource_id;
+	respawn.paused = playback.paused;
+	respawn.speed = playback.speed;
+	respawn.loop_events = ug.loop_events;
+	return respawn;
+}
+
+/**
+* Spawns the giphies of units again, restoring their playback state. Playback
+* restarts from the first frame.
+*/
+void respawn_giphies(const GiphyRespawn* respawns, unsigned count)
+{
+	for (unsigned i = 0; i < count; ++i) {
+		const auto& respawn = respawns[i];
+		if (!spawn_giphy(respawn.unit_instance, respawn.resource_id))
 			continue;
+		find_giphy(respawn.unit_instance)->loop_events = respawn.loop_events;
+		auto playback = playback_giphy(respawn.unit_instance);
+		set_giphy_speed(*playback, respawn.speed);
+		if (respawn.paused)
+			pause_giphy(*playback);
+	}
+}
 
-		// Make sure the unit has all the data we need to display a Giphy on it.
-		if (stingray::Unit->num_meshes(unit_ref) == 0 ||
-			!stingray::Data->Unit->has_data(unit_ref, 1, mesh_index_indice) ||
-			!stingray::Data->Unit->has_data(unit_ref, 1, material_slot_name_indice))
-			LOG_AND_CONTINUE("Unit #ID[%016llx] is missing Giphy property script data.", unit_resource_name);
-
-		// Get script data values
-		auto giphy_mesh_index = (unsigned)*(float*)stingray::Data->Unit->get_data(unit_ref, 1, mesh_index_indice).pointer;
-		auto giphy_resource_name = (const char*)stingray::Data->Unit->get_data(unit_ref, 1, giphy_resource_indice).pointer;
-		auto giphy_material_slot_name = (const char*)stingray::Data->Unit->get_data(unit_ref, 1, material_slot_name_indice).pointer;
-
-		// We need a valid material slot name
-		if (strlen(giphy_material_slot_name) == 0)
-			LOG_AND_CONTINUE("Unit #ID[%016llx] has an invalid material slot name", unit_resource_name);
-
-		// Make sure we can load the Giphy resource.
-		if (!resource_manager->can_get(RESOURCE_EXTENSION, giphy_resource_name))
-			LOG_AND_CONTINUE("Cannot get unit #ID[%016llx] giphy resource", unit_resource_name);
-
-		// Get the unit mesh reference on which to display the Giphy.
-		auto unit_mesh = stingray::Unit->mesh(unit_ref, giphy_mesh_index, nullptr);
-		if (stingray::Mesh->num_materials(unit_mesh) == 0)
-			LOG_AND_CONTINUE("Unit #ID[%016llx] has no material", unit_resource_name);
-
-		// Get compiled GIF resource data and length.
-		unsigned gif_data_len = 0;
-		unsigned char* gif_resource_data = (unsigned char*)resource_manager->get(RESOURCE_EXTENSION, giphy_resource_name);
-		memcpy(&gif_data_len, gif_resource_data, sizeof(gif_data_len));
-		gif_resource_data += sizeof(gif_data_len);
-
-		// Load GIF image data.
-		int width = 0, height = 0, frames = 0;
-		auto gif_frames_data = gif_load_frames((stbi_uc*)gif_resource_data, gif_data_len, &width, &height, &frames);
-		if (gif_frames_data == nullptr)
-			LOG_AND_CONTINUE("Cannot parse unit #ID[%016llx] giphy resource data", unit_resource_name);
+/**
+* Argument of a Giphy Lua module playback function, read once for all the
+* units it applies to.
+*/
+struct PlaybackArgument
+{
+	double number;
+	const char* string;
+};
 
-		// Create texture buffer view
-		RB_TextureBufferView texture_buffer_view;
-		memset(&texture_buffer_view, 0, sizeof(texture_buffer_view));
-		texture_buffer_view.width = width;
-		texture_buffer_view.height = height;
-		texture_buffer_view.depth = 1;
-		texture_buffer_view.mip_levels = 1;
-		texture_buffer_view.slices = 1;
-		texture_buffer_view.type = RB_TEXTURE_TYPE_2D;
-		texture_buffer_view.format = render_buffer->format(RB_INTEGER_COMPONENT, false, true, 8, 8, 8, 8); // ImageFormat::PF_R8G8B8A8;
+typedef bool (*UnitPlaybackFunction)(CApiUnit* unit_instance, const PlaybackArgument& argument);
 
-																										   // Create and initialize texture buffer with first GIF frame.
-		auto frame_size = width * height * 4;
-		auto texture_buffer_handle = render_buffer->create_buffer(frame_size, RB_VALIDITY_UPDATABLE, RB_TEXTURE_BUFFER_VIEW, &texture_buffer_view, gif_frames_data);
-		auto texture_buffer = render_buffer->lookup_resource(texture_buffer_handle);
+bool play_unit(CApiUnit* unit_instance, const PlaybackArgument&)
+{
+	auto ug = playback_giphy(unit_instance);
+	if (ug)
+		play_giphy(*ug);
+	return ug != nullptr;
+}
 
-		// Update the mesh material with the newly created texture buffer resource.
-		auto mesh_mat = stingray::Mesh->material(unit_mesh, 0);
-		auto material_slot_id = IdString32(giphy_material_slot_name).id();
-		stingray::Material->set_resource(mesh_mat, material_slot_id, texture_buffer);
-
-		// Associate and track the Giphy data for this unit.
-		UnitGiphy ug;
-		ug.used = true;
-		ug.unit_instance = units[i];
-		ug.gif_data = gif_frames_data;
-		ug.width = width;
-		ug.height = height;
-		ug.texture_buffer_handle = texture_buffer_handle;
-
-		// Initialize playback data.
-		auto delay = (stbi__uint16)*(gif_frames_data + frame_size);
-		ug.current_frame = 0;
-		ug.frame_count = frames;
-		ug.next_frame_delay = delay / 100.0f;
+bool pause_unit(CApiUnit* unit_instance, const PlaybackArgument&)
+{
+	auto ug = playback_giphy(unit_instance);
+	if (ug)
+		pause_giphy(*ug);
+	return ug != nullptr;
+}
+
+bool seek_unit(CApiUnit* unit_instance, const PlaybackArgument& argument)
+{
+	auto ug = playback_giphy(unit_instance);
+	return ug && seek_giphy(*ug, argument.number);
+}
+
+bool set_unit_speed(CApiUnit* unit_instance, const PlaybackArgument& argument)
+{
+	auto ug = playback_giphy(unit_instance);
+	if (ug)
+		set_giphy_speed(*ug, (float)argument.number);
+	return ug != nullptr;
+}
+
+bool set_unit_resource(CApiUnit* unit_instance, const PlaybackArgument& argument)
+{
+	return set_giphy_resource(unit_instance, argument.string);
+}
+
+/**
+* Reads the argument following the unit or units of a playback function.
+*/
+PlaybackArgument lua_playback_argument(lua_State* L)
+{
+	PlaybackArgument argument;
+	argument.number = lua->isnumber(L, 2) ? lua->tonumber(L, 2) : 0.0;
+	argument.string = lua->isstring(L, 2) ? lua->tolstring(L, 2, nullptr) : nullptr;
+	return argument;
+}
+
+/**
+* Applies a playback function to the unit at index 1, returning true if it
+* has a giphy it applied to.
+*/
+int lua_apply_to_unit(lua_State* L, UnitPlaybackFunction function)
+{
+	lua->pushboolean(L, function(lua->getunit(L, 1), lua_playback_argument(L)));
+	return 1;
+}
+
+/**
+* Applies a playback function to the array of units at index 1, returning
+* the number of units it applied to.
+*/
+int lua_apply_to_units(lua_State* L, UnitPlaybackFunction function)
+{
+	const auto argument = lua_playback_argument(L);
+	const auto count = (int)lua->objlen(L, 1);
+	lua_Integer applied = 0;
+	for (int i = 1; i <= count; ++i) {
+		lua->rawgeti(L, 1, i);
+		if (function(lua->getunit(L, -1), argument))
+			++applied;
+		lua->pop(L);
+	}
+	lua->pushinteger(L, applied);
+	return 1;
+}
+
+/**
+ * stingray.Giphy.play(unit) / stingray.Giphy.play_units(units)
+ * Resumes paused giphies. Units sharing their clock play and pause together.
+ */
+int lua_play(lua_State* L) { return lua_apply_to_unit(L, play_unit); }
+int lua_play_units(lua_State* L) { return lua_apply_to_units(L, play_unit); }
+
+/**
+ * stingray.Giphy.pause(unit) / stingray.Giphy.pause_units(units)
+ */
+int lua_pause(lua_State* L) { return lua_apply_to_unit(L, pause_unit); }
+int lua_pause_units(lua_State* L) { return lua_apply_to_units(L, pause_unit); }
 
-		// Find an unused giphy slot.
-		bool reused = false;
-		for (unsigned g = 0; g < giphies->size(); ++g) {
-			if ((*giphies)[g].used)
+/**
+ * stingray.Giphy.seek(unit, seconds) / stingray.Giphy.seek_units(units, seconds)
+ */
+int lua_seek(lua_State* L) { return lua_apply_to_unit(L, seek_unit); }
+int lua_seek_units(lua_State* L) { return lua_apply_to_units(L, seek_unit); }
+
+/**
+ * stingray.Giphy.set_speed(unit, speed) / stingray.Giphy.set_speed_units(units, speed)
+ */
+int lua_set_speed(lua_State* L) { return lua_apply_to_unit(L, set_unit_speed); }
+int lua_set_speed_units(lua_State* L) { return lua_apply_to_units(L, set_unit_speed); }
+
+/**
+ * stingray.Giphy.set_resource(unit, resource_name) / stingray.Giphy.set_resource_units(units, resource_name)
+ */
+int lua_set_resource(lua_State* L) { return lua_apply_to_unit(L, set_unit_resource); }
+int lua_set_resource_units(lua_State* L) { return lua_apply_to_units(L, set_unit_resource); }
+
+void add_playback_module_functions()
+{
+	lua->add_module_function("Giphy", "play", lua_play);
+	lua->add_module_function("Giphy", "play_units", lua_play_units);
+	lua->add_module_function("Giphy", "pause", lua_pause);
+	lua->add_module_function("Giphy", "pause_units", lua_pause_units);
+	lua->add_module_function("Giphy", "seek", lua_seek);
+	lua->add_module_function("Giphy", "seek_units", lua_seek_units);
+	lua->add_module_function("Giphy", "set_speed", lua_set_speed);
+	lua->add_module_function("Giphy", "set_speed_units", lua_set_speed_units);
+	lua->add_module_function("Giphy", "set_resource", lua_set_resource);
+	lua->add_module_function("Giphy", "set_resource_units", lua_set_resource_units);
+}
+
+/**
+* Returns the unit of the first parameter of a Flow node, or null if it is
+* not set or dead.
+*/
+CApiUnit* flow_unit(const FlowParameters* fp)
+{
+	auto unit_ref = (const CApiUnitRef*)fp->parameters[0];
+	return unit_ref ? unit_reference->dereference(*unit_ref) : nullptr;
+}
+
+/**
+* Applies a playback function to the unit of a Flow node, then triggers its
+* Out event, or its Failed event if the unit has no giphy it applied to.
+*/
+void flow_apply_to_unit(FlowTriggerContext* tc, const FlowData* fd, const FlowParameters* fp, UnitPlaybackFunction function, const PlaybackArgument& argument)
+{
+	auto unit_instance = flow_unit(fp);
+	const bool applied = unit_instance && function(unit_instance, argument);
+	flow_nodes->trigger_out_event(tc, fd, applied ? 0 : 1);
+}
+
+/**
+* Giphy Play (unit)
+*/
+void flow_play(FlowTriggerContext* tc, const FlowData* fd, const FlowParameters* fp)
+{
+	const PlaybackArgument argument = { 0.0, nullptr };
+	flow_apply_to_unit(tc, fd, fp, play_unit, argument);
+}
+
+/**
+* Giphy Pause (unit)
+*/
+void flow_pause(FlowTriggerContext* tc, const FlowData* fd, const FlowParameters* fp)
+{
+	const PlaybackArgument argument = { 0.0, nullptr };
+	flow_apply_to_unit(tc, fd, fp, pause_unit, argument);
+}
+
+/**
+* Giphy Seek (unit, time)
+*/
+void flow_seek(FlowTriggerContext* tc, const FlowData* fd, const FlowParameters* fp)
+{
+	auto time = (const float*)fp->parameters[1];
+	const PlaybackArgument argument = { time ? *time : 0.0, nullptr };
+	flow_apply_to_unit(tc, fd, fp, seek_unit, argument);
+}
+
+/**
+* Giphy Set Resource (unit, resource)
+*/
+void flow_set_resource(FlowTriggerContext* tc, const FlowData* fd, const FlowParameters* fp)
+{
+	auto resource = (const FlowString*)fp->parameters[1];
+	const PlaybackArgument argument = { 0.0, resource ? get_c_string(*resource) : nullptr };
+	flow_apply_to_unit(tc, fd, fp, set_unit_resource, argument);
+}
+
+/**
+* Giphy On Loop Completed (unit)
+* Its Listen and Ignore events make the unit get the giphy_loop_completed
+* unit event when its giphy completes a loop, or stop getting it.
+*/
+void flow_on_loop_completed(FlowTriggerContext* tc, const FlowData* fd, const FlowParameters* fp)
+{
+	auto unit_instance = flow_unit(fp);
+	auto ug = unit_instance ? find_giphy(unit_instance) : nullptr;
+	if (ug)
+		ug->loop_events = fd->event_index == 0;
+	flow_nodes->trigger_out_event(tc, fd, ug ? 0 : 1);
+}
+
+void setup_playback_flow_nodes()
+{
+	flow_nodes->setup_trigger_function(IdString32("giphy_play").id(), flow_play);
+	flow_nodes->setup_trigger_function(IdString32("giphy_pause").id(), flow_pause);
+	flow_nodes->setup_trigger_function(IdString32("giphy_seek").id(), flow_seek);
+	flow_nodes->setup_trigger_function(IdString32("giphy_set_resource").id(), flow_set_resource);
+	flow_nodes->setup_trigger_function(IdString32("giphy_on_loop_completed").id(), flow_on_loop_completed);
+}
+
+void unregister_playback_flow_nodes()
+{
+	flow_nodes->unregister_flow_node(IdString32("giphy_play").id());
+	flow_nodes->unregister_flow_node(IdString32("giphy_pause").id());
+	flow_nodes->unregister_flow_node(IdString32("giphy_seek").id());
+	flow_nodes->unregister_flow_node(IdString32("giphy_set_resource").id());
+	flow_nodes->unregister_flow_node(IdString32("giphy_on_loop_completed").id());
+}
+
+/**
+ * Returns a hash of the field offsets and struct sizes making up a data layout.
+ */
+constexpr uint64_t hash_layout(std::initializer_list<size_t> values)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (auto value : values)
+		hash = (hash ^ value) * 1099511628211ull;
+	return hash;
+}
+
+/**
+* Layout of the giphy data handed over to the reloaded plugin code, changing
+* along with the fields of any struct it is made of.
+*/
+constexpr uint64_t GIPHY_LAYOUT_HASH = hash_layout({
+	sizeof(GifFrames), offsetof(GifFrames, width), offsetof(GifFrames, height), offsetof(GifFrames, frame_count),
+	offsetof(GifFrames, format), offsetof(GifFrames, data), offsetof(GifFrames, delays), offsetof(GifFrames, palette),
+	offsetof(GifFrames, deltas), offsetof(GifFrames, rects), offsetof(GifFrames, decoded_data), offsetof(GifFrames, streamed),
+
+	sizeof(GifFrameStream), offsetof(GifFrameStream, future_archive), offsetof(GifFrameStream, archive),
+	offsetof(GifFrameStream, buffer), offsetof(GifFrameStream, read_chunk_size),
+
+	sizeof(GifCacheEntry), offsetof(GifCacheEntry, resource_id), offsetof(GifCacheEntry, resource),
+	offsetof(GifCacheEntry, loaded_resource), offsetof(GifCacheEntry, ref_count), offsetof(GifCacheEntry, frames),
+	offsetof(GifCacheEntry, decode_job), offsetof(GifCacheEntry, texture_array_handle), offsetof(GifCacheEntry, texture_array_size),
+	offsetof(GifCacheEntry, palette_handle), offsetof(GifCacheEntry, evicted), offsetof(GifCacheEntry, shared_giphy),
+	offsetof(GifCacheEntry, last_used_time),
+
+	sizeof(GiphyTarget), offsetof(GiphyTarget, mesh), offsetof(GiphyTarget, material),
+
+	sizeof(UnitGiphy), offsetof(UnitGiphy, used), offsetof(UnitGiphy, next_free), offsetof(UnitGiphy, unit_instance),
+	offsetof(UnitGiphy, gif), offsetof(UnitGiphy, stream), offsetof(UnitGiphy, texture_buffer_handle),
+	offsetof(UnitGiphy, expand_palette), offsetof(UnitGiphy, targets), offsetof(UnitGiphy, target_count),
+	offsetof(UnitGiphy, frame_index_variable), offsetof(UnitGiphy, shared_slot), offsetof(UnitGiphy, next_shared_member),
+	offsetof(UnitGiphy, playing), offsetof(UnitGiphy, frame_count), offsetof(UnitGiphy, current_frame),
+	offsetof(UnitGiphy, next_frame_time), offsetof(UnitGiphy, paused), offsetof(UnitGiphy, speed),
+	offsetof(UnitGiphy, paused_frame_time_left), offsetof(UnitGiphy, loop_events), offsetof(UnitGiphy, uploaded_frame),
+	offsetof(UnitGiphy, next_upload_time), offsetof(UnitGiphy, upload_queued_time)
+});
+
+/**
+* Runtime state handed over to the reloaded plugin code. Giphies, shared
+* frames, streams and textures stay allocated by the plugin allocator, only
+* the containers indexing them get rebuilt. If the reloaded code lays them
+* out differently, they get released from a layout independent copy instead
+* and the units spawned again.
+*/
+struct GiphyReloadState
+{
+	unsigned version;
+	uint64_t layout_hash;
+
+	AllocatorObject* allocator_object;
+	bool resources_setup;
+	bool game_setup;
+	GifLoadedResource* loaded_resources;
+	ThreadCriticalSection* loaded_resources_lock;
+
+	UnitGiphy* giphies;
+	unsigned giphy_count;
+	unsigned first_free_giphy;
+	GifCacheEntry** gifs;
+	unsigned gif_count;
+
+	// Layout independent copy of the units, textures, streams and memory the
+	// giphies hold.
+	GiphyRespawn* respawns;
+	unsigned respawn_count;
+	unsigned* buffer_handles;
+	unsigned buffer_handle_count;
+	FutureInputArchive** stream_futures;
+	InputArchive** stream_archives;
+	unsigned stream_count;
+	void** allocations;
+	unsigned allocation_count;
+	unsigned char** decoded_frames;
+	unsigned decoded_frames_count;
+
+	double playback_time;
+	GiphyView playback_view;
+	bool playback_view_set;
+	uint64_t texture_array_memory;
+	uint64_t decoded_frames_memory;
+	uint64_t upload_budget;
+};
+const unsigned GIPHY_RELOAD_STATE_VERSION = 2;
+
+/**
+ * Allocates an array of the reload state, never empty.
+ */
+template <typename T>
+T* allocate_reload_array(unsigned count)
+{
+	return (T*)_allocator.allocate(sizeof(T) * (count ? count : 1));
+}
+
+/**
+ * Called before the plugin code gets reloaded. Returns the runtime state to
+ * restore in finish_reload.
+ */
+void* start_reload(GetApiFunction get_engine_api)
+{
+	auto state = MAKE_NEW(_allocator, GiphyReloadState);
+	memset(state, 0, sizeof(GiphyReloadState));
+	state->version = GIPHY_RELOAD_STATE_VERSION;
+	state->layout_hash = GIPHY_LAYOUT_HASH;
+	state->allocator_object = allocator_object;
+	state->resources_setup = gif_resource_callbacks.load != nullptr;
+	state->game_setup = giphies != nullptr;
+	state->loaded_resources = loaded_resources;
+	state->loaded_resources_lock = loaded_resources_lock;
+	if (!state->game_setup)
+		return state;
+
+	// Decode workers run the code being unloaded. Keep the decoded frames and
+	// cancel the other jobs, they get queued again by the reloaded code.
+	state->gif_count = gif_cache->size();
+	state->gifs = allocate_reload_array<GifCacheEntry*>(state->gif_count);
+	unsigned g = 0;
+	for (auto it = gif_cache->begin(); it != gif_cache->end(); ++it) {
+		auto gif = it->second;
+		if (gif->decode_job) {
+			if (decode_workers->is_done(&gif->decode_job->task)) {
+				finish_decode_job(*gif);
+			} else {
+				release_decode_job(gif->decode_job);
+				gif->decode_job = nullptr;
+			}
+		}
+		state->gifs[g++] = gif;
+	}
+
+	state->giphy_count = giphies->size();
+	state->giphies = allocate_reload_array<UnitGiphy>(state->giphy_count);
+	memcpy(state->giphies, giphies->begin(), sizeof(UnitGiphy) * state->giphy_count);
+	state->first_free_giphy = first_free_giphy;
+
+	state->respawns = allocate_reload_array<GiphyRespawn>(state->giphy_count);
+	state->buffer_handles = allocate_reload_array<unsigned>(state->giphy_count + state->gif_count * 2);
+	state->stream_futures = allocate_reload_array<FutureInputArchive*>(state->giphy_count);
+	state->stream_archives = allocate_reload_array<InputArchive*>(state->giphy_count);
+	state->allocations = allocate_reload_array<void*>(state->giphy_count + state->gif_count);
+	state->decoded_frames = allocate_reload_array<unsigned char*>(state->gif_count);
+	for (unsigned i = 0; i < state->giphy_count; ++i) {
+		const auto& ug = state->giphies[i];
+		if (!ug.used)
+			continue;
+		if (ug.unit_instance)
+			state->respawns[state->respawn_count++] = giphy_respawn(ug);
+		if (ug.texture_buffer_handle != INVALID_HANDLE)
+			state->buffer_handles[state->buffer_handle_count++] = ug.texture_buffer_handle;
+		if (ug.stream) {
+			state->stream_futures[state->stream_count] = ug.stream->future_archive;
+			state->stream_archives[state->stream_count++] = ug.stream->archive;
+			state->allocations[state->allocation_count++] = ug.stream;
+		}
+	}
+	for (unsigned g = 0; g < state->gif_count; ++g) {
+		auto gif = state->gifs[g];
+		if (gif->texture_array_handle != INVALID_HANDLE)
+			state->buffer_handles[state->buffer_handle_count++] = gif->texture_array_handle;
+		if (gif->palette_handle != INVALID_HANDLE)
+			state->buffer_handles[state->buffer_handle_count++] = gif->palette_handle;
+		if (gif->frames.decoded_data)
+			state->decoded_frames[state->decoded_frames_count++] = gif->frames.decoded_data;
+		state->allocations[state->allocation_count++] = gif;
+	}
+
+	state->playback_time = playback_time;
+	state->playback_view = playback_view;
+	state->playback_view_set = playback_view_set;
+	state->texture_array_memory = texture_array_memory;
+	state->decoded_frames_memory = decoded_frames_memory;
+	state->upload_budget = UPLOAD_BUDGET;
+
+	delete_runtime_containers();
+	lua->remove_all_module_entries("Giphy");
+	lua = nullptr;
+	unregister_playback_flow_nodes();
+	flow_nodes = nullptr;
+	return state;
+}
+
+/**
+ * Releases the textures, streams and memory the giphies held before the
+ * reload from the layout independent copy of the reload state, then spawns
+ * the giphies of the units again.
+ */
+void respawn_reloaded_giphies(const GiphyReloadState& state)
+{
+	for (unsigned i = 0; i < state.buffer_handle_count; ++i)
+		render_buffer->destroy_buffer(state.buffer_handles[i]);
+	for (unsigned i = 0; i < state.stream_count; ++i) {
+		if (state.stream_archives[i])
+			future_input_archive->delete_archive(state.stream_archives[i], allocator_object);
+		else
+			future_input_archive->cancel(state.stream_futures[i]);
+		resource_manager->delete_stream(state.stream_futures[i], allocator_object);
+	}
+	for (unsigned i = 0; i < state.decoded_frames_count; ++i)
+		STBI_FREE(state.decoded_frames[i]);
+	for (unsigned i = 0; i < state.allocation_count; ++i)
+		_allocator.deallocate(state.allocations[i]);
+
+	// Register the frames of the loaded resources again, their shared frames
+	// got released.
+	if (loaded_resources_lock) {
+		thread->enter_critical_section(loaded_resources_lock);
+		for (auto loaded = loaded_resources; loaded; loaded = loaded->next_loaded) {
+			if (loaded->gif == nullptr)
 				continue;
-			(*giphies)[g] = ug;
-			reused = true;
-			break;
+			loaded->gif = nullptr;
+			bring_in_gif_resource(nullptr, loaded);
 		}
-		if (!reused)
-			giphies->push_back(ug);
+		thread->leave_critical_section(loaded_resources_lock);
 	}
+
+	respawn_giphies(state.respawns, state.respawn_count);
 }
 
 /**
-* When units gets unspawned, lets if we have a associated giphy, if yes,
-* lets release it.
-*/
-void units_unspawned(CApiUnit **units, unsigned count)
+ * Called once the plugin code got reloaded, to restore the runtime state
+ * saved by start_reload.
+ */
+void finish_reload(GetApiFunction get_engine_api, void* reload_state)
 {
-	for (unsigned i = 0; i < count; ++i) {
-		auto unit = units[i];
-		auto unit_giphy = find_giphy(unit);
-		if (unit_giphy)
-			release_giphy(*unit_giphy);
+	auto state = (GiphyReloadState*)reload_state;
+	allocator_object = state->allocator_object;
+	_allocator = ApiAllocator((AllocatorApi*)get_engine_api(ALLOCATOR_API_ID), allocator_object);
+	loaded_resources = state->loaded_resources;
+	loaded_resources_lock = state->loaded_resources_lock;
+
+	// The loader callbacks point to the code being unloaded.
+	if (state->resources_setup)
+		setup_resources(get_engine_api);
+
+	if (!state->game_setup) {
+		setup_common_api(get_engine_api);
+		MAKE_DELETE(_allocator, state);
+		return;
+	}
+
+	setup_plugin(get_engine_api);
+	if (state->version != GIPHY_RELOAD_STATE_VERSION) {
+		log->warning(get_name(), "Giphy reload state changed, respawn units to display their giphies again.");
+		MAKE_DELETE(_allocator, state);
+		return;
+	}
+
+	if (state->layout_hash != GIPHY_LAYOUT_HASH) {
+		log->info(get_name(), "Giphy data layout changed, spawning the giphies again.");
+		respawn_reloaded_giphies(*state);
+	} else {
+		playback_time = state->playback_time;
+		playback_view = state->playback_view;
+		playback_view_set = state->playback_view_set;
+		texture_array_memory = state->texture_array_memory;
+		decoded_frames_memory = state->decoded_frames_memory;
+		UPLOAD_BUDGET = state->upload_budget;
+
+		for (unsigned g = 0; g < state->gif_count; ++g) {
+			auto gif = state->gifs[g];
+			if (gif->frames.data == nullptr && !gif->frames.streamed && !gif->evicted)
+				gif->decode_job = queue_decode_job(gif->resource);
+			gif_cache->insert(gif->resource_id, gif);
+		}
+
+		first_free_giphy = state->first_free_giphy;
+		for (unsigned i = 0; i < state->giphy_count; ++i) {
+			const auto& ug = state->giphies[i];
+			giphies->push_back(ug);
+			if (!ug.used)
+				continue;
+			if (ug.unit_instance)
+				giphy_slots->insert(ug.unit_instance, i);
+			if (ug.shared_slot == INVALID_HANDLE)
+				giphy_schedule->schedule(i, playback_time);
+		}
 	}
+
+	_allocator.deallocate(state->gifs);
+	_allocator.deallocate(state->giphies);
+	_allocator.deallocate(state->respawns);
+	_allocator.deallocate(state->buffer_handles);
+	_allocator.deallocate(state->stream_futures);
+	_allocator.deallocate(state->stream_archives);
+	_allocator.deallocate(state->allocations);
+	_allocator.deallocate(state->decoded_frames);
+	MAKE_DELETE(_allocator, state);
+}
+
+/**
+ * Returns true for GIF resources, which can be refreshed in place.
+ */
+int can_refresh(uint64_t type)
+{
+	return type == RESOURCE_ID.id();
 }
 
+/**
+ * Called when a GIF resource got reloaded. Respawns the giphies of the units
+ * displaying it, so only its frames get decoded and uploaded again. Units
+ * keep displaying it even if set at runtime, with their playback state.
+ */
+void refresh(uint64_t type, uint64_t name)
+{
+	if (type != RESOURCE_ID.id() || giphies == nullptr || !gif_cache->has(name))
+		return;
+
+	Array<GiphyRespawn> respawns(_allocator);
+	for (unsigned g = 0; g < giphies->size(); ++g) {
+		const auto& ug = (*giphies)[g];
+		if (ug.used && ug.unit_instance && ug.gif->resource_id == name)
+			respawns.push_back(giphy_respawn(ug));
+	}
+	for (unsigned i = 0; i < respawns.size(); ++i)
+		release_giphy(*find_giphy(respawns[i].unit_instance));
+	respawn_giphies(respawns.begin(), respawns.size());
+}
 }
 
 extern "C" {
@@ -484,8 +3314,18 @@ extern "C" {
 			plugin_api.shutdown_data_compiler = shutdown_plugin;
 			plugin_api.units_spawned = units_spawned;
 			plugin_api.units_unspawned = units_unspawned;
+			plugin_api.start_reload = start_reload;
+			plugin_api.finish_reload = finish_reload;
+			plugin_api.can_refresh = can_refresh;
+			plugin_api.refresh = refresh;
 			return &plugin_api;
 		}
+
+		if (api == RENDER_CALLBACKS_PLUGIN_API_ID) {
+			static RenderCallbacksPluginApi render_callbacks = { nullptr };
+			render_callbacks.begin_frame = render_begin_frame;
+			return &render_callbacks;
+		}
 		return nullptr;
 	}
 
@@ -0,0 +1,428 @@
+#include "gif_decoder.h"
+#include "gif_kernels.h"
+
+#include <plugin_foundation/platform.h>
+
+#include <string.h>
+
+namespace PLUGIN_NAMESPACE {
+
+using namespace stingray_plugin_foundation;
+
+// GIF LZW codes are at most 12 bits wide.
+const unsigned MAX_CODE_SIZE = 12;
+const unsigned MAX_CODES = 1 << MAX_CODE_SIZE;
+
+// Strings get copied 8 bytes at a time, so buffers are padded by as much.
+const unsigned COPY_PADDING = 8;
+
+// Canvases larger than this are considered corrupt.
+const unsigned MAX_CANVAS_PIXELS = 16384 * 16384;
+
+enum GifDisposal
+{
+	GIF_DISPOSAL_NONE = 0,
+	GIF_DISPOSAL_KEEP = 1,
+	GIF_DISPOSAL_BACKGROUND = 2,
+	GIF_DISPOSAL_PREVIOUS = 3
+};
+
+namespace {
+
+unsigned read_u16(const unsigned char* p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+/**
+ * Copies a string of palette indices decoded earlier. Strings are short, so
+ * they get copied 8 bytes at a time, even if that reads past the source
+ * string or writes past the destination: the source always ends before the
+ * destination starts, and the bytes written past it get overwritten by the
+ * next strings.
+ */
+__forceinline void copy_string(unsigned char* dest, const unsigned char* src, unsigned length)
+{
+	for (;;) {
+		uint64_t chunk;
+		memcpy(&chunk, src, 8);
+		memcpy(dest, &chunk, 8);
+		if (length <= 8)
+			return;
+		length -= 8;
+		src += 8;
+		dest += 8;
+	}
+}
+
+/**
+ * Returns the image row of the n-th row of an interlaced image.
+ */
+unsigned interlaced_row(unsigned n, unsigned height)
+{
+	static const unsigned PASS_START[4] = { 0, 4, 2, 1 };
+	static const unsigned PASS_STEP[4] = { 8, 8, 4, 2 };
+	for (unsigned pass = 0; pass < 4; ++pass) {
+		const unsigned rows = height > PASS_START[pass] ? (height - PASS_START[pass] + PASS_STEP[pass] - 1) / PASS_STEP[pass] : 0;
+		if (n < rows)
+			return PASS_START[pass] + n * PASS_STEP[pass];
+		n -= rows;
+	}
+	return height;
+}
+
+}
+
+GifDecoder::GifDecoder(Allocator& allocator)
+	: _kernels(gif_kernels())
+	, _data(nullptr)
+	, _size(0)
+	, _position(0)
+	, _width(0)
+	, _height(0)
+	, _previous_disposal(GIF_DISPOSAL_NONE)
+	, _restore_pixels(allocator)
+	, _codes(allocator)
+	, _indices(allocator)
+	, _decoded_pixels(0)
+{
+	memset(&_previous_rect, 0, sizeof(_previous_rect));
+	memset(&_rect, 0, sizeof(_rect));
+}
+
+bool GifDecoder::open(const unsigned char* data, unsigned size)
+{
+	if (size < 13 || memcmp(data, "GIF", 3) != 0 || data[3] != '8' || (data[4] != '7' && data[4] != '9') || data[5] != 'a')
+		return false;
+
+	_data = data;
+	_size = size;
+	_width = read_u16(data + 6);
+	_height = read_u16(data + 8);
+	if (_width == 0 || _height == 0 || (uint64_t)_width * _height > MAX_CANVAS_PIXELS)
+		return false;
+
+	const unsigned flags = data[10];
+	_position = 13;
+	for (unsigned i = 0; i < 256; ++i)
+		_global_palette[i] = 0;
+	if ((flags & 0x80) && !read_palette(2 << (flags & 7), _global_palette))
+		return false;
+
+	_previous_disposal = GIF_DISPOSAL_NONE;
+	memset(&_previous_rect, 0, sizeof(_previous_rect));
+	return true;
+}
+
+bool GifDecoder::read_palette(unsigned entry_count, uint32_t* palette)
+{
+	if (_position + entry_count * 3 > _size)
+		return false;
+
+	// Indices past the palette entries show as opaque black.
+	const unsigned char* colors = _data + _position;
+	for (unsigned i = 0; i < 256; ++i) {
+		unsigned char color[4] = { 0, 0, 0, 255 };
+		if (i < entry_count)
+			memcpy(color, colors + i * 3, 3);
+		memcpy(palette + i, color, 4);
+	}
+	_position += entry_count * 3;
+	return true;
+}
+
+void GifDecoder::skip_sub_blocks()
+{
+	while (_position < _size && _data[_position] != 0)
+		_position += _data[_position] + 1;
+	++_position;
+}
+
+bool GifDecoder::read_image_header(ImageHeader& header)
+{
+	header.disposal = GIF_DISPOSAL_NONE;
+	header.transparent_index = -1;
+	header.delay = 0;
+
+	// Read blocks up to the next image, keeping its graphic control extension.
+	for (;;) {
+		if (_position >= _size)
+			return false;
+		const unsigned block = _data[_position++];
+		if (block == 0x2c)
+			break;
+		if (block != 0x21 || _position >= _size)
+			return false;
+
+		const unsigned label = _data[_position++];
+		if (label == 0xf9 && _position + 5 <= _size && _data[_position] >= 4) {
+			const unsigned flags = _data[_position + 1];
+			header.disposal = (flags >> 2) & 7;
+			header.delay = (unsigned short)read_u16(_data + _position + 2);
+			if (flags & 1)
+				header.transparent_index = _data[_position + 4];
+		}
+		skip_sub_blocks();
+	}
+
+	// Image descriptor and local palette.
+	if (_position + 9 > _size)
+		return false;
+	header.x = read_u16(_data + _position);
+	header.y = read_u16(_data + _position + 2);
+	header.width = read_u16(_data + _position + 4);
+	header.height = read_u16(_data + _position + 6);
+	const unsigned flags = _data[_position + 8];
+	header.interlaced = (flags & 0x40) != 0;
+	_position += 9;
+
+	// Like stb_image, reject images extending past the canvas, rather than
+	// decoding more indices than the canvas can show.
+	if (header.x + header.width > _width || header.y + header.height > _height)
+		return false;
+
+	header.palette = _global_palette;
+	if (flags & 0x80) {
+		if (!read_palette(2 << (flags & 7), _local_palette))
+			return false;
+		header.palette = _local_palette;
+	}
+	return true;
+}
+
+bool GifDecoder::skip_frame(unsigned short& delay)
+{
+	ImageHeader header;
+	if (!read_image_header(header) || _position >= _size)
+		return false;
+
+	// Skip the LZW minimum code size and data.
+	++_position;
+	skip_sub_blocks();
+	delay = header.delay;
+	return true;
+}
+
+bool GifDecoder::next_frame(unsigned char* frame, const unsigned char* previous_frame, unsigned short& delay)
+{
+	ImageHeader header;
+	if (!read_image_header(header))
+		return false;
+	delay = header.delay;
+
+	// Start from the previous frame, once disposed of.
+	auto canvas = (uint32_t*)frame;
+	const unsigned canvas_size = _width * _height * 4;
+	if (previous_frame == nullptr)
+		memset(frame, 0, canvas_size);
+	else if (previous_frame != frame)
+		memcpy(frame, previous_frame, canvas_size);
+	if (previous_frame)
+		dispose_previous_frame(canvas);
+
+	_rect.x = header.x;
+	_rect.y = header.y;
+	_rect.width = header.width;
+	_rect.height = header.height;
+
+	// Keep the pixels the frame covers if they must be restored afterwards.
+	if (header.disposal == GIF_DISPOSAL_PREVIOUS) {
+		_restore_pixels.resize(_rect.width * _rect.height);
+		_kernels.copy_rect(_restore_pixels.begin(), _rect.width, canvas + _rect.y * _width + _rect.x, _width, _rect.width, _rect.height);
+	}
+
+	if (!decode_indices(header.width * header.height))
+		return false;
+	composite(canvas, header.width, header.height, header.interlaced, header.palette, header.transparent_index);
+
+	_previous_rect = _rect;
+	_previous_disposal = header.disposal;
+	return true;
+}
+
+void GifDecoder::dispose_previous_frame(uint32_t* canvas)
+{
+	const auto& rect = _previous_rect;
+	auto pixels = canvas + rect.y * _width + rect.x;
+	if (_previous_disposal == GIF_DISPOSAL_BACKGROUND)
+		_kernels.fill_rect(pixels, _width, rect.width, rect.height, 0);
+	else if (_previous_disposal == GIF_DISPOSAL_PREVIOUS)
+		_kernels.copy_rect(pixels, _width, _restore_pixels.begin(), rect.width, rect.width, rect.height);
+}
+
+/**
+ * Decodes the LZW codes of an image to its palette indices. Dictionary
+ * entries are the location and length of their string in the indices
+ * decoded so far, so each code gets decoded by copying a string rather than
+ * walking a chain of prefixes. Codes are read from a 64-bit buffer refilled
+ * once for as many codes as it holds.
+ */
+bool GifDecoder::decode_indices(unsigned pixel_count)
+{
+	if (_position >= _size)
+		return false;
+	const unsigned min_code_size = _data[_position++];
+	if (min_code_size < 2 || min_code_size > 11)
+		return false;
+
+	// Gather the sub-blocks, padded for the bit buffer refills.
+	_codes.resize(0);
+	while (_position < _size && _data[_position] != 0) {
+		const unsigned length = _data[_position];
+		const unsigned available = _size - _position - 1;
+		const unsigned copied = length < available ? length : available;
+		const unsigned offset = _codes.size();
+		_codes.resize(offset + copied);
+		memcpy(_codes.begin() + offset, _data + _position + 1, copied);
+		_position += length + 1;
+	}
+	++_position;
+	const unsigned code_bytes = _codes.size();
+	_codes.resize(code_bytes + COPY_PADDING * 2);
+	memset(_codes.begin() + code_bytes, 0, COPY_PADDING * 2);
+
+	// Strings may be written past the last pixel before the count is checked.
+	_indices.resize(pixel_count + MAX_CODES + COPY_PADDING);
+	unsigned char* indices = _indices.begin();
+
+	uint32_t string_offsets[MAX_CODES];
+	uint16_t string_lengths[MAX_CODES];
+
+	const unsigned clear_code = 1 << min_code_size;
+	const unsigned end_code = clear_code + 1;
+	unsigned code_size = min_code_size + 1;
+	unsigned next_code = clear_code + 2;
+	bool has_previous = false;
+	unsigned previous_offset = 0, previous_length = 0;
+	unsigned pixel = 0;
+
+	const unsigned char* codes = _codes.begin();
+	const uint64_t code_bits = (uint64_t)code_bytes * 8;
+	uint64_t read_bits = 0;
+	uint64_t bits = 0;
+	unsigned bit_count = 0;
+
+	while (pixel < pixel_count) {
+		// Refill the bit buffer to at least 56 bits, enough for 4 codes.
+		uint64_t chunk;
+		memcpy(&chunk, codes, 8);
+		bits |= chunk << bit_count;
+		codes += (63 - bit_count) >> 3;
+		bit_count |= 56;
+
+		for (unsigned c = 0; c < 4 && pixel < pixel_count; ++c) {
+			// Data ending without an end code ends the image.
+			read_bits += code_size;
+			if (read_bits > code_bits) {
+				pixel_count = pixel;
+				break;
+			}
+
+			const unsigned code = (unsigned)bits & ((1 << code_size) - 1);
+			bits >>= code_size;
+			bit_count -= code_size;
+
+			if (code == clear_code) {
+				code_size = min_code_size + 1;
+				next_code = clear_code + 2;
+				has_previous = false;
+				continue;
+			}
+			if (code == end_code) {
+				pixel_count = pixel;
+				break;
+			}
+
+			unsigned length;
+			if (code < clear_code) {
+				indices[pixel] = (unsigned char)code;
+				length = 1;
+			} else if (code < next_code && has_previous) {
+				length = string_lengths[code];
+				copy_string(indices + pixel, indices + string_offsets[code], length);
+			} else if (code == next_code && has_previous) {
+				// The string of the code being defined is the previous string
+				// followed by its first index.
+				copy_string(indices + pixel, indices + previous_offset, previous_length);
+				indices[pixel + previous_length] = indices[previous_offset];
+				length = previous_length + 1;
+			} else {
+				// Invalid code, keep the pixels decoded so far.
+				pixel_count = pixel;
+				break;
+			}
+
+			if (has_previous && next_code < MAX_CODES) {
+				string_offsets[next_code] = previous_offset;
+				string_lengths[next_code] = (uint16_t)(previous_length + 1);
+				++next_code;
+				if (next_code == (1u << code_size) && code_size < MAX_CODE_SIZE)
+					++code_size;
+			}
+			has_previous = true;
+			previous_offset = pixel;
+			previous_length = length;
+			pixel += length;
+		}
+	}
+
+	_decoded_pixels = pixel < pixel_count ? pixel : pixel_count;
+	return true;
+}
+
+void GifDecoder::composite(uint32_t* canvas, unsigned image_width, unsigned image_height, bool interlaced, const uint32_t* palette, int transparent_index)
+{
+	const unsigned char* indices = _indices.begin();
+	for (unsigned n = 0; n < image_height; ++n) {
+		const unsigned first_pixel = n * image_width;
+		if (first_pixel >= _decoded_pixels)
+			break;
+		const unsigned y = interlaced ? interlaced_row(n, image_height) : n;
+		if (y >= _rect.height)
+			continue;
+
+		const unsigned decoded = _decoded_pixels - first_pixel;
+		const unsigned count = decoded < _rect.width ? decoded : _rect.width;
+		auto dest = canvas + (_rect.y + y) * _width + _rect.x;
+		if (transparent_index < 0)
+			_kernels.expand_palette(indices + first_pixel, count, palette, dest);
+		else
+			_kernels.composite_transparent(indices + first_pixel, count, palette, (unsigned)transparent_index, dest);
+	}
+}
+
+bool gif_scan_frames(const unsigned char* data, unsigned size, unsigned* width, unsigned* height, Array<unsigned short>& delays)
+{
+	GifDecoder decoder(delays.allocator());
+	if (!decoder.open(data, size))
+		return false;
+
+	delays.resize(0);
+	unsigned short delay;
+	while (decoder.skip_frame(delay))
+		delays.push_back(delay);
+	*width = decoder.width();
+	*height = decoder.height();
+	return delays.size() > 0;
+}
+
+unsigned gif_decode_frames(Allocator& allocator, const unsigned char* data, unsigned size,
+	unsigned width, unsigned height, unsigned frame_count, unsigned char* frames)
+{
+	GifDecoder decoder(allocator);
+	if (!decoder.open(data, size) || decoder.width() != width || decoder.height() != height)
+		return 0;
+
+	// Decode each frame in place after the previous one.
+	const uint64_t frame_size = (uint64_t)width * height * 4;
+	unsigned count = 0;
+	unsigned short delay;
+	for (; count < frame_count; ++count) {
+		auto frame = frames + frame_size * count;
+		if (!decoder.next_frame(frame, count ? frame - frame_size : nullptr, delay))
+			break;
+	}
+	return count;
+}
+
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <plugin_foundation/allocator.h>
+#include <plugin_foundation/array.h>
+
+#include <stdint.h>
+
+namespace PLUGIN_NAMESPACE {
+
+struct GifKernels;
+
+/**
+ * Decoder of the frames of GIF data, one after the other, composited over
+ * the previous frame to R8G8B8A8 canvases. The LZW codes of a frame are
+ * decoded to palette indices, which then get composited to the canvas along
+ * with the disposal of the previous frame in a single pass over its
+ * rectangle. Shared by the engine and editor plugins.
+ */
+class GifDecoder
+{
+public:
+	explicit GifDecoder(stingray_plugin_foundation::Allocator& allocator);
+
+	/**
+	 * Reads the header of GIF data, which must stay unchanged until done
+	 * decoding. Returns false if the data is not a GIF.
+	 */
+	bool open(const unsigned char* data, unsigned size);
+
+	unsigned width() const { return _width; }
+	unsigned height() const { return _height; }
+
+	/**
+	 * Decodes the next frame to `frame`, composited over `previous_frame`,
+	 * the canvas the previous frame got decoded to. Both can be the same
+	 * canvas, and the first frame gets composited over a transparent canvas
+	 * if null. Sets the frame delay, in 1/100 seconds. Returns false once all
+	 * frames were decoded, or if the data is corrupt.
+	 */
+	bool next_frame(unsigned char* frame, const unsigned char* previous_frame, unsigned short& delay);
+
+	/**
+	 * Skips the next frame without decoding it, only reading its delay.
+	 * Returns false once all frames were skipped.
+	 */
+	bool skip_frame(unsigned short& delay);
+
+private:
+	// Rectangle of a frame, within the canvas.
+	struct FrameRect
+	{
+		unsigned x, y, width, height;
+	};
+
+	// Graphic control and image descriptor of a frame.
+	struct ImageHeader
+	{
+		unsigned x, y, width, height;
+		bool interlaced;
+		unsigned disposal;
+		int transparent_index;
+		unsigned short delay;
+		const uint32_t* palette;
+	};
+
+	void skip_sub_blocks();
+	bool read_image_header(ImageHeader& header);
+	bool read_palette(unsigned entry_count, uint32_t* palette);
+	bool decode_indices(unsigned pixel_count);
+	void dispose_previous_frame(uint32_t* canvas);
+	void composite(uint32_t* canvas, unsigned image_width, unsigned image_height, bool interlaced, const uint32_t* palette, int transparent_index);
+
+	const GifKernels& _kernels;
+
+	const unsigned char* _data;
+	unsigned _size;
+	unsigned _position;
+
+	unsigned _width;
+	unsigned _height;
+	uint32_t _global_palette[256];
+	uint32_t _local_palette[256];
+
+	// Previous frame rectangle and disposal, with the canvas pixels it covered
+	// if they must be restored.
+	FrameRect _previous_rect;
+	unsigned _previous_disposal;
+	stingray_plugin_foundation::Array<uint32_t> _restore_pixels;
+
+	// LZW data of the current frame gathered from its sub-blocks, and the
+	// palette indices it decodes to.
+	stingray_plugin_foundation::Array<unsigned char> _codes;
+	stingray_plugin_foundation::Array<unsigned char> _indices;
+	unsigned _decoded_pixels;
+	FrameRect _rect;
+};
+
+/**
+ * Reads the canvas size and the frame delays of GIF data, in 1/100 seconds,
+ * without decoding the frames, so that they can be decoded to a single
+ * allocation. Returns false if the data is not a GIF.
+ */
+bool gif_scan_frames(const unsigned char* data, unsigned size, unsigned* width, unsigned* height,
+	stingray_plugin_foundation::Array<unsigned short>& delays);
+
+/**
+ * Decodes up to `frame_count` frames of GIF data to `frames`, R8G8B8A8 frames
+ * of the canvas size back to back. Returns the number of frames decoded,
+ * fewer if the data is corrupt, or 0 if the data is not a GIF of that size.
+ */
+unsigned gif_decode_frames(stingray_plugin_foundation::Allocator& allocator, const unsigned char* data, unsigned size,
+	unsigned width, unsigned height, unsigned frame_count, unsigned char* frames);
+
+}
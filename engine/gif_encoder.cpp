@@ -0,0 +1,183 @@
+#include "gif_encoder.h"
+#include "block_encoder.h"
+#include "gif_kernels.h"
+
+#include <string.h>
+
+namespace PLUGIN_NAMESPACE {
+
+using namespace stingray_plugin_foundation;
+
+// Dirty rows separated by less clean rows than this are merged in the same band.
+const unsigned DIRTY_BAND_MERGE_ROWS = 8;
+
+// Frames changing in more bands than this get a single bounding rectangle.
+const unsigned MAX_DIRTY_RECTS_PER_FRAME = 16;
+
+unsigned find_dirty_rects(const unsigned char* prev_frame, const unsigned char* frame, unsigned width, unsigned height,
+	unsigned block_size, Array<GifDirtyRect>& rects)
+{
+	const unsigned first_rect = rects.size();
+	const unsigned row_size = width * 4;
+	const unsigned* prev_pixels = (const unsigned*)prev_frame;
+	const unsigned* pixels = (const unsigned*)frame;
+
+	bool band_open = false;
+	unsigned band_min_x = 0, band_max_x = 0, band_first_row = 0, band_last_row = 0;
+
+	for (unsigned y = 0; y < height; ++y) {
+		const unsigned row = y * width;
+		if (memcmp(prev_pixels + row, pixels + row, row_size) == 0)
+			continue;
+
+		// Find the changing span of the row.
+		unsigned min_x = 0, max_x = width - 1;
+		while (prev_pixels[row + min_x] == pixels[row + min_x])
+			++min_x;
+		while (prev_pixels[row + max_x] == pixels[row + max_x])
+			--max_x;
+
+		// Close the current band if too many clean rows separate it from this row.
+		if (band_open && y - band_last_row > DIRTY_BAND_MERGE_ROWS) {
+			GifDirtyRect rect = { (unsigned short)band_min_x, (unsigned short)band_first_row,
+				(unsigned short)(band_max_x - band_min_x + 1), (unsigned short)(band_last_row - band_first_row + 1), 0 };
+			rects.push_back(rect);
+			band_open = false;
+		}
+
+		if (!band_open) {
+			band_open = true;
+			band_first_row = y;
+			band_min_x = min_x;
+			band_max_x = max_x;
+		} else {
+			band_min_x = min_x < band_min_x ? min_x : band_min_x;
+			band_max_x = max_x > band_max_x ? max_x : band_max_x;
+		}
+		band_last_row = y;
+	}
+
+	if (band_open) {
+		GifDirtyRect rect = { (unsigned short)band_min_x, (unsigned short)band_first_row,
+			(unsigned short)(band_max_x - band_min_x + 1), (unsigned short)(band_last_row - band_first_row + 1), 0 };
+		rects.push_back(rect);
+	}
+
+	// Collapse too many bands into their bounding rectangle to bound the number of uploads.
+	if (rects.size() - first_rect > MAX_DIRTY_RECTS_PER_FRAME) {
+		unsigned min_x = width, max_x = 0, min_y = height, max_y = 0;
+		for (unsigned i = first_rect; i < rects.size(); ++i) {
+			const auto& rect = rects[i];
+			min_x = rect.x < min_x ? rect.x : min_x;
+			min_y = rect.y < min_y ? rect.y : min_y;
+			max_x = rect.x + rect.width > max_x ? rect.x + rect.width : max_x;
+			max_y = rect.y + rect.height > max_y ? rect.y + rect.height : max_y;
+		}
+		GifDirtyRect bounds = { (unsigned short)min_x, (unsigned short)min_y, (unsigned short)(max_x - min_x), (unsigned short)(max_y - min_y), 0 };
+		rects.resize(first_rect);
+		rects.push_back(bounds);
+	}
+
+	// Grow the rectangles to the blocks they touch.
+	for (unsigned i = first_rect; i < rects.size(); ++i) {
+		auto& rect = rects[i];
+		const unsigned x = rect.x / block_size * block_size;
+		const unsigned y = rect.y / block_size * block_size;
+		rect.width = (unsigned short)((rect.x + rect.width + block_size - 1) / block_size * block_size - x);
+		rect.height = (unsigned short)((rect.y + rect.height + block_size - 1) / block_size * block_size - y);
+		rect.x = (unsigned short)x;
+		rect.y = (unsigned short)y;
+	}
+
+	return rects.size() - first_rect;
+}
+
+bool has_transparent_pixels(const unsigned char* frames, uint64_t pixel_count)
+{
+	for (uint64_t i = 0; i < pixel_count; ++i) {
+		if (frames[i * 4 + 3] != 255)
+			return true;
+	}
+	return false;
+}
+
+unsigned build_palette(const unsigned char* frames, uint64_t pixel_count, unsigned* palette, unsigned char* indices)
+{
+	// Open addressing table of the colors found so far, twice the palette size
+	// to keep probing short.
+	const unsigned table_size = GIF_PALETTE_SIZE * 2;
+	unsigned table_colors[table_size];
+	int table_indices[table_size];
+	for (unsigned i = 0; i < table_size; ++i)
+		table_indices[i] = -1;
+
+	const unsigned* pixels = (const unsigned*)frames;
+	unsigned color_count = 0;
+	for (uint64_t p = 0; p < pixel_count; ++p) {
+		const unsigned color = pixels[p];
+		unsigned slot = (color * 2654435761u) >> 23;
+		while (table_indices[slot] >= 0 && table_colors[slot] != color)
+			slot = (slot + 1) % table_size;
+
+		if (table_indices[slot] < 0) {
+			if (color_count == GIF_PALETTE_SIZE)
+				return 0;
+			table_colors[slot] = color;
+			table_indices[slot] = color_count;
+			palette[color_count++] = color;
+		}
+		indices[p] = (unsigned char)table_indices[slot];
+	}
+
+	for (unsigned i = color_count; i < GIF_PALETTE_SIZE; ++i)
+		palette[i] = 0;
+	return color_count;
+}
+
+void expand_indexed_pixels(const unsigned char* indices, unsigned pixel_count, const unsigned* palette, unsigned char* dest)
+{
+	gif_kernels().expand_palette(indices, pixel_count, (const uint32_t*)palette, (uint32_t*)dest);
+}
+
+void pack_rect_pixels(const unsigned char* frame, unsigned width, const GifDirtyRect& rect, unsigned format, unsigned char* dest)
+{
+	const unsigned pixel_size = format == GIF_FORMAT_INDEXED8 ? 1 : 4;
+	const unsigned stride = width * pixel_size;
+	const unsigned char* src = frame + rect.y * stride + rect.x * pixel_size;
+	if (format == GIF_FORMAT_R8G8B8A8 || format == GIF_FORMAT_INDEXED8) {
+		const unsigned rect_row_size = rect.width * pixel_size;
+		for (unsigned y = 0; y < rect.height; ++y) {
+			memcpy(dest, src, rect_row_size);
+			dest += rect_row_size;
+			src += stride;
+		}
+		return;
+	}
+
+	const unsigned block_bytes = gif_format_block_bytes(format);
+	for (unsigned y = 0; y < rect.height; y += 4) {
+		for (unsigned x = 0; x < rect.width; x += 4) {
+			if (format == GIF_FORMAT_BC1)
+				compress_bc1_block(src + y * stride + x * 4, stride, dest);
+			else
+				compress_bc3_block(src + y * stride + x * 4, stride, dest);
+			dest += block_bytes;
+		}
+	}
+}
+
+void unpack_rect_pixels(const unsigned char* src, unsigned width, const GifDirtyRect& rect, unsigned format, unsigned char* frame)
+{
+	const unsigned block_size = gif_format_block_size(format);
+	const unsigned block_bytes = gif_format_block_bytes(format);
+	const unsigned stride = width / block_size * block_bytes;
+	const unsigned rect_row_size = rect.width / block_size * block_bytes;
+	unsigned char* dest = frame + rect.y / block_size * stride + rect.x / block_size * block_bytes;
+	for (unsigned y = 0; y < rect.height; y += block_size) {
+		memcpy(dest, src, rect_row_size);
+		dest += stride;
+		src += rect_row_size;
+	}
+}
+
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <plugin_foundation/array.h>
+
+#include "gif_resource.h"
+
+namespace PLUGIN_NAMESPACE {
+
+/**
+ * Appends to `rects` the rectangles covering all the pixels that differ
+ * between two R8G8B8A8 frames. Rows are grouped into horizontal bands so a
+ * few disjoint changing regions do not upload everything in between.
+ * Rectangles are aligned to `block_size` pixels, which the frame dimensions
+ * must be a multiple of. Returns the number of rectangles added. The
+ * rectangles data offsets are left for the caller to assign.
+ */
+unsigned find_dirty_rects(const unsigned char* prev_frame, const unsigned char* frame, unsigned width, unsigned height,
+	unsigned block_size, stingray_plugin_foundation::Array<GifDirtyRect>& rects);
+
+/**
+ * Returns true if any pixel of the R8G8B8A8 frames is not fully opaque.
+ */
+bool has_transparent_pixels(const unsigned char* frames, uint64_t pixel_count);
+
+/**
+ * Builds the palette of the distinct colors of R8G8B8A8 frames and converts
+ * the frames to 8-bit indices into it. Returns the number of colors, or 0 if
+ * the frames have more than GIF_PALETTE_SIZE colors.
+ */
+unsigned build_palette(const unsigned char* frames, uint64_t pixel_count, unsigned* palette, unsigned char* indices);
+
+/**
+ * Converts 8-bit palette indices to R8G8B8A8 pixels.
+ */
+void expand_indexed_pixels(const unsigned char* indices, unsigned pixel_count, const unsigned* palette, unsigned char* dest);
+
+/**
+ * Encodes the pixels of a rectangle of a R8G8B8A8 frame to a GifPixelFormat,
+ * tightly packed to `dest`. GIF_FORMAT_INDEXED8 rectangles are copied from a
+ * frame of indices instead.
+ */
+void pack_rect_pixels(const unsigned char* frame, unsigned width, const GifDirtyRect& rect, unsigned format, unsigned char* dest);
+
+/**
+ * Copies the tightly packed pixels of a rectangle back into a frame of the
+ * same GifPixelFormat.
+ */
+void unpack_rect_pixels(const unsigned char* src, unsigned width, const GifDirtyRect& rect, unsigned format, unsigned char* frame);
+
+}
@@ -0,0 +1,238 @@
+#include "gif_kernels.h"
+
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+	#define GIF_KERNELS_X86 1
+	#if defined(_MSC_VER) && !defined(__clang__)
+		#include <intrin.h>
+		#define TARGET_SSE41
+		#define TARGET_AVX2
+	#else
+		#include <cpuid.h>
+		#define TARGET_SSE41 __attribute__((target("sse4.1")))
+		#define TARGET_AVX2 __attribute__((target("avx2")))
+	#endif
+	#include <immintrin.h>
+#endif
+
+namespace PLUGIN_NAMESPACE {
+
+namespace {
+
+void expand_palette_scalar(const unsigned char* indices, unsigned count, const uint32_t* palette, uint32_t* dest)
+{
+	for (unsigned i = 0; i < count; ++i)
+		dest[i] = palette[indices[i]];
+}
+
+void composite_transparent_scalar(const unsigned char* indices, unsigned count, const uint32_t* palette, unsigned transparent_index, uint32_t* dest)
+{
+	for (unsigned i = 0; i < count; ++i) {
+		const unsigned index = indices[i];
+		if (index != transparent_index)
+			dest[i] = palette[index];
+	}
+}
+
+void fill_rect_scalar(uint32_t* dest, unsigned dest_stride, unsigned width, unsigned height, uint32_t color)
+{
+	for (unsigned y = 0; y < height; ++y, dest += dest_stride) {
+		for (unsigned x = 0; x < width; ++x)
+			dest[x] = color;
+	}
+}
+
+void copy_rect_scalar(uint32_t* dest, unsigned dest_stride, const uint32_t* src, unsigned src_stride, unsigned width, unsigned height)
+{
+	for (unsigned y = 0; y < height; ++y, dest += dest_stride, src += src_stride)
+		memcpy(dest, src, width * 4);
+}
+
+#if GIF_KERNELS_X86
+
+/**
+ * Returns the palette colors of 4 indices. SSE has no gather, but building
+ * the vector from scalar loads still beats storing the colors one by one.
+ */
+TARGET_SSE41 __m128i palette_colors_sse41(const unsigned char* indices, const uint32_t* palette)
+{
+	return _mm_setr_epi32((int)palette[indices[0]], (int)palette[indices[1]], (int)palette[indices[2]], (int)palette[indices[3]]);
+}
+
+TARGET_SSE41 void expand_palette_sse41(const unsigned char* indices, unsigned count, const uint32_t* palette, uint32_t* dest)
+{
+	unsigned i = 0;
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_si128((__m128i*)(dest + i), palette_colors_sse41(indices + i, palette));
+	expand_palette_scalar(indices + i, count - i, palette, dest + i);
+}
+
+/**
+ * Blends the palette colors over the canvas with the transparent pixels as
+ * mask, skipping runs of 4 transparent pixels, common in frames only
+ * updating part of the canvas.
+ */
+TARGET_SSE41 void composite_transparent_sse41(const unsigned char* indices, unsigned count, const uint32_t* palette, unsigned transparent_index, uint32_t* dest)
+{
+	const __m128i transparent = _mm_set1_epi32((int)transparent_index);
+	unsigned i = 0;
+	for (; i + 4 <= count; i += 4) {
+		int packed_indices;
+		memcpy(&packed_indices, indices + i, 4);
+		const __m128i index = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed_indices));
+		const __m128i keep = _mm_cmpeq_epi32(index, transparent);
+		if (_mm_movemask_epi8(keep) == 0xffff)
+			continue;
+		const __m128i canvas = _mm_loadu_si128((const __m128i*)(dest + i));
+		_mm_storeu_si128((__m128i*)(dest + i), _mm_blendv_epi8(palette_colors_sse41(indices + i, palette), canvas, keep));
+	}
+	composite_transparent_scalar(indices + i, count - i, palette, transparent_index, dest + i);
+}
+
+TARGET_SSE41 void fill_rect_sse41(uint32_t* dest, unsigned dest_stride, unsigned width, unsigned height, uint32_t color)
+{
+	const __m128i colors = _mm_set1_epi32((int)color);
+	for (unsigned y = 0; y < height; ++y, dest += dest_stride) {
+		unsigned x = 0;
+		for (; x + 4 <= width; x += 4)
+			_mm_storeu_si128((__m128i*)(dest + x), colors);
+		for (; x < width; ++x)
+			dest[x] = color;
+	}
+}
+
+TARGET_SSE41 void copy_rect_sse41(uint32_t* dest, unsigned dest_stride, const uint32_t* src, unsigned src_stride, unsigned width, unsigned height)
+{
+	for (unsigned y = 0; y < height; ++y, dest += dest_stride, src += src_stride) {
+		unsigned x = 0;
+		for (; x + 4 <= width; x += 4)
+			_mm_storeu_si128((__m128i*)(dest + x), _mm_loadu_si128((const __m128i*)(src + x)));
+		for (; x < width; ++x)
+			dest[x] = src[x];
+	}
+}
+
+TARGET_AVX2 void expand_palette_avx2(const unsigned char* indices, unsigned count, const uint32_t* palette, uint32_t* dest)
+{
+	unsigned i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const __m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(indices + i)));
+		_mm256_storeu_si256((__m256i*)(dest + i), _mm256_i32gather_epi32((const int*)palette, index, 4));
+	}
+	expand_palette_scalar(indices + i, count - i, palette, dest + i);
+}
+
+/**
+ * Gathers the palette colors of the opaque pixels only, over the canvas
+ * pixels, skipping runs of 8 transparent pixels.
+ */
+TARGET_AVX2 void composite_transparent_avx2(const unsigned char* indices, unsigned count, const uint32_t* palette, unsigned transparent_index, uint32_t* dest)
+{
+	const __m256i transparent = _mm256_set1_epi32((int)transparent_index);
+	unsigned i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const __m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(indices + i)));
+		const __m256i keep = _mm256_cmpeq_epi32(index, transparent);
+		if (_mm256_movemask_epi8(keep) == -1)
+			continue;
+		const __m256i opaque = _mm256_xor_si256(keep, _mm256_set1_epi32(-1));
+		const __m256i canvas = _mm256_loadu_si256((const __m256i*)(dest + i));
+		_mm256_storeu_si256((__m256i*)(dest + i), _mm256_mask_i32gather_epi32(canvas, (const int*)palette, index, opaque, 4));
+	}
+	composite_transparent_scalar(indices + i, count - i, palette, transparent_index, dest + i);
+}
+
+TARGET_AVX2 void fill_rect_avx2(uint32_t* dest, unsigned dest_stride, unsigned width, unsigned height, uint32_t color)
+{
+	const __m256i colors = _mm256_set1_epi32((int)color);
+	for (unsigned y = 0; y < height; ++y, dest += dest_stride) {
+		unsigned x = 0;
+		for (; x + 8 <= width; x += 8)
+			_mm256_storeu_si256((__m256i*)(dest + x), colors);
+		for (; x < width; ++x)
+			dest[x] = color;
+	}
+}
+
+TARGET_AVX2 void copy_rect_avx2(uint32_t* dest, unsigned dest_stride, const uint32_t* src, unsigned src_stride, unsigned width, unsigned height)
+{
+	for (unsigned y = 0; y < height; ++y, dest += dest_stride, src += src_stride) {
+		unsigned x = 0;
+		for (; x + 8 <= width; x += 8)
+			_mm256_storeu_si256((__m256i*)(dest + x), _mm256_loadu_si256((const __m256i*)(src + x)));
+		for (; x < width; ++x)
+			dest[x] = src[x];
+	}
+}
+
+void cpuid(unsigned leaf, unsigned registers[4])
+{
+	#if defined(_MSC_VER) && !defined(__clang__)
+		__cpuidex((int*)registers, (int)leaf, 0);
+	#else
+		__cpuid_count(leaf, 0, registers[0], registers[1], registers[2], registers[3]);
+	#endif
+}
+
+/**
+ * Returns the register states the OS saves on context switches.
+ */
+uint64_t os_saved_states()
+{
+	#if defined(_MSC_VER) && !defined(__clang__)
+		return _xgetbv(0);
+	#else
+		unsigned low, high;
+		__asm__("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+		return ((uint64_t)high << 32) | low;
+	#endif
+}
+
+#endif
+
+GifKernels select_kernels()
+{
+	GifKernels kernels = { expand_palette_scalar, composite_transparent_scalar, fill_rect_scalar, copy_rect_scalar };
+
+	#if GIF_KERNELS_X86
+		unsigned registers[4];
+		cpuid(0, registers);
+		const unsigned max_leaf = registers[0];
+		if (max_leaf < 1)
+			return kernels;
+
+		cpuid(1, registers);
+		const bool sse41 = (registers[2] & (1 << 19)) != 0;
+		const bool osxsave = (registers[2] & (1 << 27)) != 0;
+		if (sse41) {
+			kernels.expand_palette = expand_palette_sse41;
+			kernels.composite_transparent = composite_transparent_sse41;
+			kernels.fill_rect = fill_rect_sse41;
+			kernels.copy_rect = copy_rect_sse41;
+		}
+
+		// AVX2 also needs the OS to save the YMM registers.
+		if (max_leaf < 7 || !osxsave || (os_saved_states() & 6) != 6)
+			return kernels;
+		cpuid(7, registers);
+		if (registers[1] & (1 << 5)) {
+			kernels.expand_palette = expand_palette_avx2;
+			kernels.composite_transparent = composite_transparent_avx2;
+			kernels.fill_rect = fill_rect_avx2;
+			kernels.copy_rect = copy_rect_avx2;
+		}
+	#endif
+
+	return kernels;
+}
+
+}
+
+const GifKernels& gif_kernels()
+{
+	static const GifKernels kernels = select_kernels();
+	return kernels;
+}
+
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace PLUGIN_NAMESPACE {
+
+/**
+ * Inner loops of GIF frame decoding. SSE4.1 and AVX2 versions get picked at
+ * runtime from the CPU features, with scalar versions for other CPUs.
+ */
+struct GifKernels
+{
+	// Writes the palette colors of `count` indices to `dest`.
+	void (*expand_palette)(const unsigned char* indices, unsigned count, const uint32_t* palette, uint32_t* dest);
+
+	// Same as expand_palette, but leaves the pixels of the transparent index
+	// unchanged.
+	void (*composite_transparent)(const unsigned char* indices, unsigned count, const uint32_t* palette, unsigned transparent_index, uint32_t* dest);
+
+	// Fills a rectangle of pixels with a color, to dispose of a frame to the
+	// background.
+	void (*fill_rect)(uint32_t* dest, unsigned dest_stride, unsigned width, unsigned height, uint32_t color);
+
+	// Copies a rectangle of pixels, to save or restore the pixels a frame
+	// covers. Strides are in pixels.
+	void (*copy_rect)(uint32_t* dest, unsigned dest_stride, const uint32_t* src, unsigned src_stride, unsigned width, unsigned height);
+};
+
+/**
+ * Returns the kernels best suited to the CPU, detected on the first call.
+ */
+const GifKernels& gif_kernels();
+
+}
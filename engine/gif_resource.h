@@ -0,0 +1,183 @@
+#pragma once
+
+namespace PLUGIN_NAMESPACE {
+
+/**
+ * Version of the compiled GIF resource binary format. Increase it whenever the
+ * layout below changes so the data compiler recompiles all GIF resources.
+ */
+const unsigned GIF_RESOURCE_VERSION = 7;
+
+/**
+ * Alignment of the frame data block inside a compiled GIF resource.
+ */
+const unsigned GIF_RESOURCE_DATA_ALIGN = 16;
+
+/**
+ * Describes how the frame data block of a compiled GIF resource is encoded.
+ */
+enum GifResourceEncoding
+{
+	// Original GIF file bytes, decoded at runtime. Used when the composited
+	// frames would be too large for the 32-bit sizes of the resource stream.
+	GIF_ENCODING_SOURCE = 0,
+
+	// Composited frames ready to upload: the first frame is stored as a full
+	// key frame followed by the packed pixels of the rectangles that
+	// changed between consecutive frames. The rectangles are laid out in
+	// playback order starting from the second frame, the first frame ones
+	// coming last, so the frame data can be read sequentially.
+	GIF_ENCODING_DELTA = 1,
+
+	// Same as GIF_ENCODING_DELTA, but the frame data is stored in the
+	// resource stream to be streamed in while playing.
+	GIF_ENCODING_STREAM = 2
+};
+
+/**
+ * Pixel format of the frames of a compiled GIF resource. Block compressed
+ * frames are stored as rows of 4x4 pixel blocks.
+ */
+enum GifPixelFormat
+{
+	GIF_FORMAT_R8G8B8A8 = 0,
+
+	// Used for opaque GIFs.
+	GIF_FORMAT_BC1 = 1,
+
+	// Used for GIFs with transparent pixels.
+	GIF_FORMAT_BC3 = 2,
+
+	// 8-bit indices in a 256 colors R8G8B8A8 palette. Used for GIFs with at
+	// most 256 colors over all their frames that would not use BC1.
+	GIF_FORMAT_INDEXED8 = 3
+};
+
+/**
+ * Number of colors of the palette of GIF_FORMAT_INDEXED8 frames.
+ */
+const unsigned GIF_PALETTE_SIZE = 256;
+
+/**
+ * Returns the width and height in pixels of the blocks of a pixel format.
+ */
+inline unsigned gif_format_block_size(unsigned format)
+{
+	return format == GIF_FORMAT_BC1 || format == GIF_FORMAT_BC3 ? 4 : 1;
+}
+
+/**
+ * Returns the size in bytes of the blocks of a pixel format.
+ */
+inline unsigned gif_format_block_bytes(unsigned format)
+{
+	return format == GIF_FORMAT_BC1 ? 8 : format == GIF_FORMAT_BC3 ? 16 : format == GIF_FORMAT_INDEXED8 ? 1 : 4;
+}
+
+/**
+ * Returns the size of the pixels of an image, which dimensions must be a
+ * multiple of the format block size.
+ */
+inline unsigned gif_image_size(unsigned width, unsigned height, unsigned format)
+{
+	const unsigned block_size = gif_format_block_size(format);
+	return (width / block_size) * (height / block_size) * gif_format_block_bytes(format);
+}
+
+/**
+ * Rectangle of pixels that changed from the previous frame.
+ */
+struct GifDirtyRect
+{
+	unsigned short x;
+	unsigned short y;
+	unsigned short width;
+	unsigned short height;
+
+	// Offset of the packed rectangle pixels in the frame data. Rectangles of
+	// block compressed frames are aligned to blocks.
+	unsigned data_offset;
+};
+
+/**
+ * Range of dirty rectangles to upload when a frame gets displayed. The
+ * rectangles of the first frame restore it from the last frame when the
+ * animation loops.
+ */
+struct GifFrameDelta
+{
+	unsigned first_rect;
+	unsigned rect_count;
+};
+
+/**
+ * Header of a compiled GIF resource. All offsets are relative to the start
+ * of the header. Source encoded frames are always decoded to R8G8B8A8. The
+ * frame data of streamed resources starts at position 0 of the resource stream
+ * instead. Layout:
+ *
+ *   [GifResourceHeader]
+ *   [unsigned short delays[frame_count]]	Frame delays in 1/100 seconds.
+ *   [GifFrameDelta deltas[frame_count]]	Not for GIF_ENCODING_SOURCE.
+ *   [GifDirtyRect rects[rect_count]]		Not for GIF_ENCODING_SOURCE.
+ *   [unsigned palette[GIF_PALETTE_SIZE]]	Only for GIF_FORMAT_INDEXED8.
+ *   [frame data]							Aligned to GIF_RESOURCE_DATA_ALIGN, not for GIF_ENCODING_STREAM.
+ */
+struct GifResourceHeader
+{
+	unsigned version;
+	unsigned encoding;
+	unsigned format;
+	unsigned width;
+	unsigned height;
+	unsigned frame_count;
+	unsigned delays_offset;
+	unsigned deltas_offset;
+	unsigned rects_offset;
+	unsigned rect_count;
+	unsigned palette_offset;
+	unsigned data_offset;
+	unsigned data_size;
+};
+
+/**
+ * Returns the frame delays of a compiled GIF resource.
+ */
+inline const unsigned short* gif_resource_delays(const GifResourceHeader* header)
+{
+	return (const unsigned short*)((const char*)header + header->delays_offset);
+}
+
+/**
+ * Returns the per frame dirty rectangle ranges of a delta encoded or streamed GIF resource.
+ */
+inline const GifFrameDelta* gif_resource_deltas(const GifResourceHeader* header)
+{
+	return (const GifFrameDelta*)((const char*)header + header->deltas_offset);
+}
+
+/**
+ * Returns the dirty rectangles of a delta encoded or streamed GIF resource.
+ */
+inline const GifDirtyRect* gif_resource_rects(const GifResourceHeader* header)
+{
+	return (const GifDirtyRect*)((const char*)header + header->rects_offset);
+}
+
+/**
+ * Returns the R8G8B8A8 palette of indexed GIF resource frames.
+ */
+inline const unsigned* gif_resource_palette(const GifResourceHeader* header)
+{
+	return (const unsigned*)((const char*)header + header->palette_offset);
+}
+
+/**
+ * Returns the encoded frame data of a compiled GIF resource.
+ */
+inline const unsigned char* gif_resource_data(const GifResourceHeader* header)
+{
+	return (const unsigned char*)header + header->data_offset;
+}
+
+}
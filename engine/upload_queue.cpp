@@ -0,0 +1,131 @@
+#include "upload_queue.h"
+
+#include <string.h>
+
+namespace PLUGIN_NAMESPACE {
+
+using namespace stingray_plugin_foundation;
+
+UploadQueue::UploadQueue(RenderBufferApi* render_buffer_api, ApiAllocator& allocator)
+	: _render_buffer_api(render_buffer_api)
+	, _allocator(allocator)
+	, _recording(allocator)
+	, _published(0)
+	, _consumed(0)
+	, _render_thread_ready(false)
+	, _render_thread_executes(false)
+{
+	for (unsigned i = 0; i < BATCH_RING_SIZE; ++i)
+		_ring[i] = MAKE_NEW(_allocator, Batch, _allocator);
+}
+
+UploadQueue::~UploadQueue()
+{
+	for (unsigned i = 0; i < BATCH_RING_SIZE; ++i)
+		MAKE_DELETE(_allocator, _ring[i]);
+}
+
+void UploadQueue::update_buffer(unsigned handle, unsigned size, const void* data, bool stage)
+{
+	Update update;
+	memset(&update, 0, sizeof(update));
+	update.handle = handle;
+	update.partial = false;
+	update.data_size = size;
+	record(update, data, stage);
+}
+
+void UploadQueue::update_texture(unsigned handle, const uint32_t* offset, const uint32_t* size, const void* data, unsigned data_size, bool stage)
+{
+	Update update;
+	update.handle = handle;
+	update.partial = true;
+	for (unsigned c = 0; c < 3; ++c) {
+		update.offset[c] = offset[c];
+		update.size[c] = size[c];
+	}
+	update.data_size = data_size;
+	record(update, data, stage);
+}
+
+void UploadQueue::record(Update& update, const void* data, bool stage)
+{
+	update.data = (const unsigned char*)data;
+	update.staging_offset = 0;
+	if (stage) {
+		update.data = nullptr;
+		update.staging_offset = _recording.staging.size();
+		_recording.staging.resize(update.staging_offset + update.data_size);
+		memcpy(_recording.staging.begin() + update.staging_offset, data, update.data_size);
+	}
+	_recording.updates.push_back(update);
+}
+
+void UploadQueue::submit()
+{
+	const uint64_t published = _published.load(std::memory_order_relaxed);
+
+	// Execute the updates on the game thread until the render thread calls in.
+	if (!_render_thread_executes.load(std::memory_order_relaxed)) {
+		if (!_render_thread_ready.load(std::memory_order_acquire)) {
+			execute_batch(_recording);
+			_recording.updates.resize(0);
+			_recording.staging.resize(0);
+			_published.store(published + 1, std::memory_order_relaxed);
+			_consumed.store(published + 1, std::memory_order_relaxed);
+			return;
+		}
+		_render_thread_executes.store(true, std::memory_order_release);
+	}
+
+	// Keep recording in the same batch while the ring is full.
+	if (published - _consumed.load(std::memory_order_acquire) >= BATCH_RING_SIZE)
+		return;
+
+	// The ring slot batch was executed, recycle it to record the next one.
+	auto& batch = *_ring[published % BATCH_RING_SIZE];
+	batch.updates.swap(_recording.updates);
+	batch.staging.swap(_recording.staging);
+	_recording.updates.resize(0);
+	_recording.staging.resize(0);
+	_published.store(published + 1, std::memory_order_release);
+}
+
+void UploadQueue::drain()
+{
+	const uint64_t published = _published.load(std::memory_order_acquire);
+	for (uint64_t consumed = _consumed.load(std::memory_order_relaxed); consumed < published; ++consumed)
+		execute_batch(*_ring[consumed % BATCH_RING_SIZE]);
+	execute_batch(_recording);
+	_recording.updates.resize(0);
+	_recording.staging.resize(0);
+	_published.store(published + 1, std::memory_order_relaxed);
+	_consumed.store(published + 1, std::memory_order_release);
+}
+
+void UploadQueue::execute()
+{
+	_render_thread_ready.store(true, std::memory_order_release);
+	if (!_render_thread_executes.load(std::memory_order_acquire))
+		return;
+
+	const uint64_t published = _published.load(std::memory_order_acquire);
+	for (uint64_t consumed = _consumed.load(std::memory_order_relaxed); consumed < published; ++consumed) {
+		execute_batch(*_ring[consumed % BATCH_RING_SIZE]);
+		_consumed.store(consumed + 1, std::memory_order_release);
+	}
+}
+
+void UploadQueue::execute_batch(Batch& batch)
+{
+	for (unsigned i = 0; i < batch.updates.size(); ++i) {
+		auto& update = batch.updates[i];
+		const void* data = update.data ? update.data : batch.staging.begin() + update.staging_offset;
+		if (update.partial)
+			_render_buffer_api->partial_update_texture(update.handle, 0, 0, 0, update.offset, update.size, data);
+		else
+			_render_buffer_api->update_buffer(update.handle, update.data_size, data);
+	}
+}
+
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <engine_plugin_api/plugin_api.h>
+#include <plugin_foundation/allocator.h>
+#include <plugin_foundation/array.h>
+
+#include <atomic>
+
+namespace PLUGIN_NAMESPACE {
+
+/**
+ * Texture updates recorded by the game thread and executed by the render
+ * thread when it begins its next frame. Each game frame records its updates
+ * in a batch handed over through a single producer, single consumer ring.
+ *
+ * Updates reference their source data, which must stay unchanged until the
+ * batch fence passed, or get copied in the batch when staged. Until the
+ * render thread calls execute(), batches get executed on the game thread.
+ * The queue must be detached from the render thread before being drained
+ * and deleted, and can be attached again once drained.
+ */
+class UploadQueue
+{
+public:
+	UploadQueue(RenderBufferApi* render_buffer_api, stingray_plugin_foundation::ApiAllocator& allocator);
+	~UploadQueue();
+
+	/**
+	 * Records an update of a whole buffer.
+	 */
+	void update_buffer(unsigned handle, unsigned size, const void* data, bool stage);
+
+	/**
+	 * Records an update of a region of the first mip of a texture buffer.
+	 */
+	void update_texture(unsigned handle, const uint32_t* offset, const uint32_t* size, const void* data, unsigned data_size, bool stage);
+
+	/**
+	 * Hands the updates recorded this frame over to the render thread, or
+	 * executes them if it is not executing them yet. Updates stay recorded if
+	 * the render thread is too far behind.
+	 */
+	void submit();
+
+	/**
+	 * Returns the fence of the updates being recorded, and if the updates of
+	 * a fence were executed.
+	 */
+	uint64_t fence() const { return _published.load(std::memory_order_relaxed) + 1; }
+	bool fence_passed(uint64_t fence) const { return _consumed.load(std::memory_order_acquire) >= fence; }
+
+	/**
+	 * Executes all the updates left on the game thread, once the render thread
+	 * no longer calls execute().
+	 */
+	void drain();
+
+	/**
+	 * Executes the submitted updates. Called by the render thread.
+	 */
+	void execute();
+
+private:
+	struct Update
+	{
+		unsigned handle;
+		bool partial;
+		uint32_t offset[3];
+		uint32_t size[3];
+		unsigned data_size;
+
+		// Source data, or null if staged in the batch.
+		const unsigned char* data;
+		unsigned staging_offset;
+	};
+
+	struct Batch
+	{
+		explicit Batch(stingray_plugin_foundation::Allocator& allocator) : updates(allocator), staging(allocator) {}
+
+		stingray_plugin_foundation::Array<Update> updates;
+		stingray_plugin_foundation::Array<unsigned char> staging;
+	};
+
+	void record(Update& update, const void* data, bool stage);
+	void execute_batch(Batch& batch);
+
+	static const unsigned BATCH_RING_SIZE = 4;
+
+	RenderBufferApi* _render_buffer_api;
+	stingray_plugin_foundation::ApiAllocator _allocator;
+
+	// Batch recorded by the game thread, and batches handed over.
+	Batch _recording;
+	Batch* _ring[BATCH_RING_SIZE];
+
+	// Number of batches handed over and executed. Both get advanced by the
+	// game thread until the render thread executes batches.
+	std::atomic<uint64_t> _published;
+	std::atomic<uint64_t> _consumed;
+	std::atomic<bool> _render_thread_ready;
+	std::atomic<bool> _render_thread_executes;
+};
+
+}
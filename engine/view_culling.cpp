@@ -0,0 +1,64 @@
+#include "view_culling.h"
+
+#include <math.h>
+
+namespace PLUGIN_NAMESPACE {
+
+namespace {
+
+float dot(const float* a, const float* b)
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+}
+
+void make_giphy_view(const float* pose, float vertical_fov, float aspect_ratio, GiphyView& view)
+{
+	for (unsigned c = 0; c < 3; ++c) {
+		view.right[c] = pose[c];
+		view.forward[c] = pose[4 + c];
+		view.up[c] = pose[8 + c];
+		view.position[c] = pose[12 + c];
+	}
+	view.tan_half_fov_y = tanf(vertical_fov * 0.5f);
+	view.tan_half_fov_x = view.tan_half_fov_y * aspect_ratio;
+}
+
+void world_bounding_sphere(const float* local_min, const float* local_max, const float* pose, float* center, float& radius)
+{
+	float local_center[3], half_extent[3];
+	for (unsigned c = 0; c < 3; ++c) {
+		local_center[c] = (local_min[c] + local_max[c]) * 0.5f;
+		half_extent[c] = (local_max[c] - local_min[c]) * 0.5f;
+	}
+
+	// Poses are row major with the translation in the last row.
+	float max_scale = 0.0f;
+	for (unsigned c = 0; c < 3; ++c) {
+		center[c] = local_center[0] * pose[c] + local_center[1] * pose[4 + c] + local_center[2] * pose[8 + c] + pose[12 + c];
+		const float scale = sqrtf(dot(pose + c * 4, pose + c * 4));
+		max_scale = scale > max_scale ? scale : max_scale;
+	}
+	radius = sqrtf(dot(half_extent, half_extent)) * max_scale;
+}
+
+bool sphere_in_view(const GiphyView& view, const float* center, float radius, float& distance)
+{
+	const float offset[3] = { center[0] - view.position[0], center[1] - view.position[1], center[2] - view.position[2] };
+	const float length = sqrtf(dot(offset, offset));
+	distance = length > radius ? length - radius : 0.0f;
+
+	const float y = dot(offset, view.forward);
+	if (y < -radius)
+		return false;
+
+	// Compare against the side planes pushed out by the sphere radius.
+	const float x = fabsf(dot(offset, view.right));
+	const float z = fabsf(dot(offset, view.up));
+	const float x_margin = radius * sqrtf(1.0f + view.tan_half_fov_x * view.tan_half_fov_x);
+	const float z_margin = radius * sqrtf(1.0f + view.tan_half_fov_y * view.tan_half_fov_y);
+	return x <= y * view.tan_half_fov_x + x_margin && z <= y * view.tan_half_fov_y + z_margin;
+}
+
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+namespace PLUGIN_NAMESPACE {
+
+/**
+ * Camera view giphies are culled and throttled against. Cameras look along
+ * their pose Y axis with Z up.
+ */
+struct GiphyView
+{
+	float position[3];
+	float right[3];
+	float forward[3];
+	float up[3];
+
+	// Tangents of the half horizontal and vertical field of views.
+	float tan_half_fov_x;
+	float tan_half_fov_y;
+};
+
+/**
+ * Builds a view from a camera world pose, its vertical field of view in
+ * radians and its viewport aspect ratio (width / height).
+ */
+void make_giphy_view(const float* pose, float vertical_fov, float aspect_ratio, GiphyView& view);
+
+/**
+ * Computes the world bounding sphere of a mesh local bounding box.
+ */
+void world_bounding_sphere(const float* local_min, const float* local_max, const float* pose, float* center, float& radius);
+
+/**
+ * Returns true if a sphere intersects the view frustum, ignoring the near and
+ * far planes. `distance` receives the distance from the view to the sphere.
+ */
+bool sphere_in_view(const GiphyView& view, const float* center, float radius, float& distance);
+
+}
@@ -0,0 +1,168 @@
+#include "worker_pool.h"
+
+namespace PLUGIN_NAMESPACE {
+
+using namespace stingray_plugin_foundation;
+
+WorkerPool::WorkerPool(ThreadApi* thread_api, ProfilerApi* profiler_api, ApiAllocator& allocator, const char* name, unsigned worker_count)
+	: _thread_api(thread_api)
+	, _profiler_api(profiler_api)
+	, _allocator(allocator)
+	, _name(name)
+	, _worker_count(worker_count)
+	, _workers(allocator)
+	, _first(nullptr)
+	, _last(nullptr)
+	, _orphan_count(0)
+	, _quit(false)
+{
+	_lock = _thread_api->create_critical_section(_allocator.object());
+	_work_event = _thread_api->create_event(_allocator.object(), true, false, name);
+	_done_event = _thread_api->create_event(_allocator.object(), false, false, name);
+}
+
+WorkerPool::~WorkerPool()
+{
+	_thread_api->enter_critical_section(_lock);
+	_quit = true;
+	_thread_api->set_event(_work_event);
+	_thread_api->leave_critical_section(_lock);
+
+	for (unsigned i = 0; i < _workers.size(); ++i)
+		_thread_api->wait_for_thread(_workers[i]);
+
+	_thread_api->destroy_event(_done_event, _allocator.object());
+	_thread_api->destroy_event(_work_event, _allocator.object());
+	_thread_api->destroy_critical_section(_lock, _allocator.object());
+}
+
+void WorkerPool::queue(WorkerTask* task)
+{
+	if (_workers.empty())
+		start_workers();
+
+	task->state = WORKER_TASK_QUEUED;
+	task->orphaned = false;
+	task->next = nullptr;
+
+	_thread_api->enter_critical_section(_lock);
+	if (_last)
+		_last->next = task;
+	else
+		_first = task;
+	_last = task;
+	_thread_api->set_event(_work_event);
+	_thread_api->leave_critical_section(_lock);
+}
+
+bool WorkerPool::is_done(WorkerTask* task)
+{
+	_thread_api->enter_critical_section(_lock);
+	const bool done = task->state == WORKER_TASK_DONE;
+	_thread_api->leave_critical_section(_lock);
+	return done;
+}
+
+void WorkerPool::orphan(WorkerTask* task)
+{
+	_thread_api->enter_critical_section(_lock);
+	const bool running = task->state == WORKER_TASK_RUNNING;
+	if (running) {
+		task->orphaned = true;
+		++_orphan_count;
+	} else if (task->state == WORKER_TASK_QUEUED) {
+		unqueue(task);
+	}
+	_thread_api->leave_critical_section(_lock);
+
+	// A running task cannot be interrupted, its worker releases it.
+	if (!running)
+		task->release(task);
+}
+
+void WorkerPool::wait_for_orphans()
+{
+	for (;;) {
+		_thread_api->enter_critical_section(_lock);
+		const unsigned orphan_count = _orphan_count;
+		_thread_api->leave_critical_section(_lock);
+		if (orphan_count == 0)
+			return;
+		_thread_api->wait_for_event_timeout(_done_event, 1);
+	}
+}
+
+void WorkerPool::unqueue(WorkerTask* task)
+{
+	WorkerTask* prev = nullptr;
+	for (auto t = _first; t != task; t = t->next)
+		prev = t;
+	if (prev)
+		prev->next = task->next;
+	else
+		_first = task->next;
+	if (_last == task)
+		_last = prev;
+	task->state = WORKER_TASK_DONE;
+}
+
+void WorkerPool::start_workers()
+{
+	for (unsigned i = 0; i < _worker_count; ++i)
+		_workers.push_back(_thread_api->create_thread(_name, worker_entry, this, PLUGIN_THREAD_PRIORITY_BELOW_NORMAL));
+}
+
+void WorkerPool::worker_entry(void* user_data)
+{
+	auto pool = (WorkerPool*)user_data;
+	if (pool->_profiler_api)
+		pool->_profiler_api->make_thread_profiler(pool->_allocator.object());
+
+	pool->execute_tasks();
+
+	if (pool->_profiler_api)
+		pool->_profiler_api->delete_thread_profiler(pool->_allocator.object());
+}
+
+void WorkerPool::execute_tasks()
+{
+	for (;;) {
+		_thread_api->wait_for_event(_work_event);
+
+		_thread_api->enter_critical_section(_lock);
+		if (_quit) {
+			_thread_api->leave_critical_section(_lock);
+			return;
+		}
+		auto task = _first;
+		if (task) {
+			_first = task->next;
+			if (_first == nullptr)
+				_last = nullptr;
+			task->state = WORKER_TASK_RUNNING;
+		}
+		if (_first == nullptr)
+			_thread_api->reset_event(_work_event);
+		_thread_api->leave_critical_section(_lock);
+
+		if (task == nullptr)
+			continue;
+
+		task->execute(task);
+
+		_thread_api->enter_critical_section(_lock);
+		task->state = WORKER_TASK_DONE;
+		const bool orphaned = task->orphaned;
+		_thread_api->leave_critical_section(_lock);
+
+		if (orphaned) {
+			task->release(task);
+			_thread_api->enter_critical_section(_lock);
+			--_orphan_count;
+			_thread_api->leave_critical_section(_lock);
+		}
+		_thread_api->set_event(_done_event);
+	}
+}
+
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <engine_plugin_api/plugin_api.h>
+#include <plugin_foundation/allocator.h>
+#include <plugin_foundation/array.h>
+
+namespace PLUGIN_NAMESPACE {
+
+/**
+ * States a worker task goes through.
+ */
+enum WorkerTaskState
+{
+	WORKER_TASK_QUEUED,
+	WORKER_TASK_RUNNING,
+	WORKER_TASK_DONE
+};
+
+/**
+ * Unit of work executed by a WorkerPool. Embed it as the first member of a
+ * struct holding the task input and output.
+ */
+struct WorkerTask
+{
+	// Function executed on a worker thread.
+	void (*execute)(WorkerTask* task);
+
+	// Function releasing the task once done, if orphaned while running.
+	void (*release)(WorkerTask* task);
+
+	// Current WorkerTaskState, guarded by the pool lock.
+	int state;
+
+	// True if the task gets released by its worker once done.
+	bool orphaned;
+
+	// Next queued task.
+	WorkerTask* next;
+};
+
+/**
+ * Pool of worker threads created with the engine ThreadApi executing tasks in
+ * the order they were queued. Threads get created when the first task is
+ * queued, along with their engine profiler if a ProfilerApi is given. Tasks
+ * are owned by the caller, which must keep them alive until they are done or
+ * orphaned.
+ */
+class WorkerPool
+{
+public:
+	WorkerPool(ThreadApi* thread_api, ProfilerApi* profiler_api, stingray_plugin_foundation::ApiAllocator& allocator, const char* name, unsigned worker_count);
+	~WorkerPool();
+
+	// Queues a task to be executed by the next available worker.
+	void queue(WorkerTask* task);
+
+	// Returns true if the task was executed.
+	bool is_done(WorkerTask* task);
+
+	// Hands a task over to the pool, which releases it right away if not
+	// running, or from its worker once done otherwise. Never blocks.
+	void orphan(WorkerTask* task);
+
+	// Waits for the running orphaned tasks to be released.
+	void wait_for_orphans();
+
+private:
+	static void worker_entry(void* user_data);
+	void start_workers();
+	void unqueue(WorkerTask* task);
+	void execute_tasks();
+
+	ThreadApi* _thread_api;
+	ProfilerApi* _profiler_api;
+	stingray_plugin_foundation::ApiAllocator _allocator;
+	const char* _name;
+	unsigned _worker_count;
+	stingray_plugin_foundation::Array<ThreadID> _workers;
+
+	ThreadCriticalSection* _lock;
+	ThreadEvent* _work_event;
+	ThreadEvent* _done_event;
+	WorkerTask* _first;
+	WorkerTask* _last;
+	unsigned _orphan_count;
+	bool _quit;
+};
+
+}